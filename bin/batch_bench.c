@@ -0,0 +1,209 @@
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "common.h"
+#include "logging.h"
+#include "moves.h"
+#include "fen.h"
+#include "batch.h"
+
+#define DEFAULT_REPEAT 100
+
+static const char* path = NULL;
+static int repeat = DEFAULT_REPEAT;
+
+void usage_exit(char* const progname) {
+    fprintf(stderr, "Usage: %s -f file [-r repeat]\n", progname);
+    exit(EXIT_FAILURE);
+}
+
+void parse_args(int argc, char* const argv[]) {
+    static struct option const longopts[] = {
+        {
+            .name = "file",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'f',
+        },
+        {
+            .name = "repeat",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'r',
+        },
+        {0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:r:", longopts, NULL)) != -1) {
+        switch (opt) {
+            case 'f':
+                path = optarg;
+                break;
+
+            case 'r': {
+                char* endp;
+                repeat = strtol(optarg, &endp, 10);
+                if (optarg == endp || repeat < 1) {
+                    log_error("invalid repeat count");
+                    usage_exit(argv[0]);
+                }
+                break;
+            }
+
+            default: /* '?' */
+                usage_exit(argv[0]);
+        }
+    }
+    if (!path) {
+        log_error("missing fen file");
+        usage_exit(argv[0]);
+    }
+    if (optind != argc) {
+        log_error("unexpected arguments");
+        usage_exit(argv[0]);
+    }
+}
+
+double elapsed_seconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Positions the batch code once got wrong, always checked on top of the file's
+static const char* const regression_fens[] = {
+    // Two captures promoting on the same square
+    "1r6/P1P3p1/2p1k3/5bPp/4p3/3P2P1/8/6BK w - - 3 34",
+};
+static const size_t n_regression_fens = sizeof(regression_fens) / sizeof(regression_fens[0]);
+
+// Parses one FEN per line, blank lines are skipped, after `regression_fens`
+Result read_games(const char* path, Game** games, size_t* count) {
+    FILE* file = fopen(path, "r");
+    ASSERT_OR(file, LIBC);
+
+    size_t capacity = 1024;
+    *games = malloc(capacity * sizeof(Game));
+    *count = 0;
+    ASSERT_OR(*games, LIBC);
+    for (size_t i = 0; i < n_regression_fens; i++) {
+        ASSERT_OK(parse_fen(&(*games)[*count], regression_fens[i]));
+        (*count)++;
+    }
+
+    char* line = NULL;
+    size_t line_size = 0;
+    Result res = RESULT_OK;
+    while (getline(&line, &line_size, file) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        if (*count == capacity) {
+            capacity *= 2;
+            Game* grown = realloc(*games, capacity * sizeof(Game));
+            if (!grown) {
+                res = ERROR(LIBC);
+                break;
+            }
+            *games = grown;
+        }
+        res = parse_fen(&(*games)[*count], line);
+        if (res != RESULT_OK) {
+            log_error("%s: %s", line, get_error_msg(res));
+            break;
+        }
+        (*count)++;
+    }
+    free(line);
+    fclose(file);
+    return res;
+}
+
+// Positions per second of `count_moves` over the whole batch
+double time_batch(PositionBatch* batch, void (*count_moves)(PositionBatch*)) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < repeat; i++)
+        count_moves(batch);
+    return (double)batch->count * repeat / elapsed_seconds(&start);
+}
+
+// Compares the batch results against the move generator and the attack maps
+// of the games, returns the number of positions that differ
+size_t check_batch(PositionBatch* batch, Game* games, const char* name) {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        MoveList list;
+        int count = all_valid_moves(&games[i], &list);
+        bool ok = batch->move_counts[i] == (uint64_t)count
+               && batch->attacks[COLOR_WHITE][i] == games[i].attacks.by_color[COLOR_WHITE]
+               && batch->attacks[COLOR_BLACK][i] == games[i].attacks.by_color[COLOR_BLACK];
+        if (!ok) {
+            if (mismatches == 0) {
+                char fen[MAX_FEN_LENGTH + 1];
+                game_fen(&games[i], fen);
+                log_error("%s: %s: %lu moves, expected %d", name, fen, batch->move_counts[i], count);
+            }
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char* const argv[]) {
+    parse_args(argc, argv);
+
+    Game* games;
+    size_t count;
+    Result res = read_games(path, &games, &count);
+    if (res != RESULT_OK) {
+        log_error("%s: %s", path, get_error_msg(res));
+        return EXIT_FAILURE;
+    }
+
+    PositionBatch batch;
+    res = position_batch_init(&batch, count);
+    if (res != RESULT_OK) {
+        log_error("batch: %s", get_error_msg(res));
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < count; i++)
+        position_batch_add(&batch, &games[i]);
+
+    // Baseline: the move generator, one game at a time
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t total_moves = 0;
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < count; i++) {
+            MoveList list;
+            total_moves += all_valid_moves(&games[i], &list);
+        }
+    }
+    double generator_rate = (double)count * repeat / elapsed_seconds(&start);
+    printf("%zu positions, %lu moves, %d repeats\n", count, total_moves / repeat, repeat);
+    printf("generator: %12.0f positions/s\n", generator_rate);
+
+    size_t mismatches = 0;
+    double scalar_rate = time_batch(&batch, batch_count_moves_scalar);
+    mismatches += check_batch(&batch, games, "scalar");
+    printf("scalar:    %12.0f positions/s (%.2fx)\n", scalar_rate, scalar_rate / generator_rate);
+
+#if defined(__x86_64__)
+    if (batch_has_avx2()) {
+        double avx2_rate = time_batch(&batch, batch_count_moves_avx2);
+        mismatches += check_batch(&batch, games, "avx2");
+        printf("avx2:      %12.0f positions/s (%.2fx)\n", avx2_rate, avx2_rate / generator_rate);
+    } else {
+        printf("avx2:      not supported by this CPU\n");
+    }
+#else
+    printf("avx2:      not built for this architecture\n");
+#endif
+
+    printf("%zu mismatch(es)\n", mismatches);
+    position_batch_free(&batch);
+    free(games);
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,281 @@
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "logging.h"
+#include "uci.h"
+#include "fen.h"
+#include "search.h"
+#include "nnue.h"
+
+#define ENGINE_NAME "engine_chess"
+#define ENGINE_AUTHOR "engine_chess developers"
+// Size of the transposition table in megabytes
+#define DEFAULT_HASH 16
+#define MAX_HASH 65536
+#define MAX_THREADS 512
+// Nodes searched in each position by `bench`
+#define BENCH_NODES 1000000
+
+static Game position;
+// Positions played before `position`, to tell repetitions with them
+static uint64_t position_hashes[UCI_POSITION_HASHES];
+static int n_position_hashes = 0;
+static TranspositionTable tt;
+// One per thread, the first reports and picks the move
+static Search* searches;
+static int n_threads = 1;
+static SearchOptions options;
+// Evaluation network from the EvalFile option, piece-square tables without one
+static Network network;
+static bool has_network = false;
+// Accumulator of `position`, each search keeps one of its own
+static Accumulator position_accumulator;
+static pthread_t search_thread;
+static bool searching = false;
+
+static void* search_main(void* arg) {
+    (void)arg;
+    Move best = search_run_threads(searches, n_threads);
+    char uci[MOVE_UCI_LENGTH];
+    if (best == NULL_MOVE) {
+        printf("bestmove 0000\n");
+        return NULL;
+    }
+    move_to_uci(best, uci);
+    Move ponder = searches[0].ponder_move;
+    if (ponder == NULL_MOVE) {
+        printf("bestmove %s\n", uci);
+        return NULL;
+    }
+    char ponder_uci[MOVE_UCI_LENGTH];
+    move_to_uci(ponder, ponder_uci);
+    printf("bestmove %s ponder %s\n", uci, ponder_uci);
+    return NULL;
+}
+
+// Waits for the running search, if any, to print its best move
+static void stop_search(void) {
+    if (!searching) return;
+    search_stop(&searches[0]);
+    pthread_join(search_thread, NULL);
+    searching = false;
+}
+
+static Result start_search(UciGo limits) {
+    stop_search();
+    tt_new_search(&tt);
+    nnue_attach(&position, has_network ? &network : NULL, &position_accumulator);
+    for (int i = 0; i < n_threads; i++) {
+        search_init(&searches[i], &position, limits, &tt, stdout);
+        search_set_played(&searches[i], position_hashes, n_position_hashes);
+        searches[i].options = options;
+    }
+    int err = pthread_create(&search_thread, NULL, search_main, NULL);
+    if (err) {
+        errno = err;
+        return ERROR(LIBC);
+    }
+    searching = true;
+    return RESULT_OK;
+}
+
+// Searches each of the bench positions for `nodes` nodes on one thread from
+// an empty transposition table, and prints the total nodes and speed.
+// Searching the same nodes, any change in the speed is the code's.
+static void bench(int nodes) {
+    stop_search();
+    if (nodes == 0) nodes = BENCH_NODES;
+    Search* search = &searches[0];
+    uint64_t total_nodes = 0;
+    uint64_t total_ms = 0;
+    for (size_t i = 0; i < n_bench_positions; i++) {
+        Game game;
+        Accumulator accumulator;
+        parse_fen(&game, bench_positions[i]);
+        nnue_attach(&game, has_network ? &network : NULL, &accumulator);
+        tt_clear(&tt);
+        tt_new_search(&tt);
+        search_init(search, &game, (UciGo){ .nodes = nodes }, &tt, NULL);
+        search->options = options;
+        search_run(search);
+        total_nodes += search_nodes(search);
+        total_ms += search_elapsed_ms(search);
+    }
+    printf("bench positions %zu nodes %lu nps %lu time %lu\n", n_bench_positions, total_nodes,
+           total_ms > 0 ? total_nodes * 1000 / total_ms : 0, total_ms);
+}
+
+// Value of a `check` option
+static Result parse_check(const char* value, bool* out) {
+    ASSERT_OR(value, INVALID_UCI);
+    if (strcmp(value, "true") == 0)
+        *out = true;
+    else if (strcmp(value, "false") == 0)
+        *out = false;
+    else
+        return ERROR(INVALID_UCI);
+    return RESULT_OK;
+}
+
+static Result set_option(UciSetOption option) {
+    if (strcasecmp(option.name, "Hash") == 0) {
+        ASSERT_OR(option.value, INVALID_UCI);
+        char* endp;
+        long megabytes = strtol(option.value, &endp, 10);
+        ASSERT_OR(endp != option.value && megabytes >= 1 && megabytes <= MAX_HASH, INVALID_UCI);
+        stop_search();
+        // The old table stays in use if the new one can't be allocated
+        TranspositionTable resized;
+        ASSERT_OK(tt_init(&resized, megabytes));
+        tt_free(&tt);
+        tt = resized;
+        return RESULT_OK;
+    }
+    if (strcasecmp(option.name, "Threads") == 0) {
+        ASSERT_OR(option.value, INVALID_UCI);
+        char* endp;
+        long threads = strtol(option.value, &endp, 10);
+        ASSERT_OR(endp != option.value && threads >= 1 && threads <= MAX_THREADS, INVALID_UCI);
+        stop_search();
+        Search* resized = realloc(searches, threads * sizeof(Search));
+        ASSERT_OR(resized, LIBC);
+        searches = resized;
+        n_threads = threads;
+        return RESULT_OK;
+    }
+    if (strcasecmp(option.name, "EvalFile") == 0) {
+        stop_search();
+        Network loaded = {0};
+        bool load = option.value && *option.value && strcmp(option.value, "<empty>") != 0;
+        if (load)
+            ASSERT_OK(nnue_load(&loaded, option.value));
+        if (has_network)
+            nnue_free(&network);
+        network = loaded;
+        has_network = load;
+        return RESULT_OK;
+    }
+    // Only tells the GUI that the engine can ponder, the GUI decides when with
+    // `go ponder`
+    if (strcasecmp(option.name, "Ponder") == 0) {
+        bool ponder;
+        return parse_check(option.value, &ponder);
+    }
+    if (strcasecmp(option.name, "NullMove") == 0)
+        return parse_check(option.value, &options.null_move);
+    if (strcasecmp(option.name, "LateMoveReductions") == 0)
+        return parse_check(option.value, &options.late_move_reductions);
+    if (strcasecmp(option.name, "Futility") == 0)
+        return parse_check(option.value, &options.futility);
+    log_error("unknown option %s", option.name);
+    return RESULT_OK;
+}
+
+int main(void) {
+    setbuf(stdout, NULL);
+    options = search_default_options;
+    parse_fen(&position, FEN_STARTING);
+    Result res = tt_init(&tt, DEFAULT_HASH);
+    if (res != RESULT_OK) {
+        log_error("hash: %s", get_error_msg(res));
+        return EXIT_FAILURE;
+    }
+    searches = malloc(sizeof(Search));
+    if (!searches) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    char* line = NULL;
+    size_t linecap = 0;
+    while (getline(&line, &linecap, stdin) != EOF) {
+        UciCommand cmd;
+        res = uci_parse_command(line, &cmd);
+        if (res != RESULT_OK) {
+            log_error("invalid UCI command: %s", get_error_msg(res));
+            continue;
+        }
+
+        switch (cmd.kind) {
+            case UCI_INIT:
+                printf("id name %s\n", ENGINE_NAME);
+                printf("id author %s\n", ENGINE_AUTHOR);
+                printf("option name Hash type spin default %d min 1 max %d\n", DEFAULT_HASH, MAX_HASH);
+                printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+                printf("option name EvalFile type string default <empty>\n");
+                printf("option name Ponder type check default true\n");
+                printf("option name NullMove type check default %s\n", search_default_options.null_move ? "true" : "false");
+                printf("option name LateMoveReductions type check default %s\n",
+                       search_default_options.late_move_reductions ? "true" : "false");
+                printf("option name Futility type check default %s\n", search_default_options.futility ? "true" : "false");
+                printf("uciok\n");
+                break;
+
+            case UCI_ISREADY:
+                printf("readyok\n");
+                break;
+
+            case UCI_NEWGAME:
+                stop_search();
+                parse_fen(&position, FEN_STARTING);
+                n_position_hashes = 0;
+                tt_clear(&tt);
+                break;
+
+            case UCI_SETOPTION:
+                res = set_option(cmd.setoption);
+                if (res != RESULT_OK)
+                    log_error("setoption %s: %s", cmd.setoption.name, get_error_msg(res));
+                break;
+
+            case UCI_POSITION:
+                stop_search();
+                position = cmd.position.game;
+                memcpy(position_hashes, cmd.position.hashes, cmd.position.n_hashes * sizeof(uint64_t));
+                n_position_hashes = cmd.position.n_hashes;
+                break;
+
+            case UCI_GO:
+                res = start_search(cmd.go);
+                if (res != RESULT_OK)
+                    log_error("failed to start the search: %s", get_error_msg(res));
+                break;
+
+            case UCI_STOP:
+                stop_search();
+                break;
+
+            case UCI_PONDERHIT:
+                if (searching)
+                    search_ponderhit(&searches[0]);
+                break;
+
+            case UCI_BENCH:
+                bench(cmd.bench);
+                break;
+
+            case UCI_QUIT:
+                stop_search();
+                tt_free(&tt);
+                if (has_network)
+                    nnue_free(&network);
+                free(searches);
+                free(line);
+                return EXIT_SUCCESS;
+
+            default:
+                break;
+        }
+    }
+
+    stop_search();
+    tt_free(&tt);
+    if (has_network)
+        nnue_free(&network);
+    free(searches);
+    free(line);
+    return EXIT_SUCCESS;
+}
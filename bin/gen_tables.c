@@ -0,0 +1,243 @@
+// Computes the attack tables of `bitboard.h` and the Zobrist keys of
+// `zobrist.h` and prints them as C source, so that they are compiled into the
+// binaries rather than built on every startup.
+//
+// Usage: gen_tables > tables.c
+
+#define GEN_TABLES
+#include "common.h"
+#include "bitboard.h"
+#include "zobrist.h"
+
+Bitboard knight_attacks[64];
+Bitboard king_attacks[64];
+Bitboard pawn_attacks[2][64];
+Magic bishop_magics[64];
+Magic rook_magics[64];
+Bitboard bishop_rays[64];
+Bitboard rook_rays[64];
+Bitboard between_squares[64][64];
+Bitboard line_squares[64][64];
+
+uint64_t zobrist_pieces[2][NUM_PIECE_KINDS][64];
+uint64_t zobrist_castling[16];
+uint64_t zobrist_en_passant[8];
+uint64_t zobrist_black_to_move;
+
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+
+// Every possible occupancy of every square, see `init_magics` for the sizes
+#define BISHOP_TABLE_SIZE 0x1480
+#define ROOK_TABLE_SIZE 0x19000
+static Bitboard bishop_table[BISHOP_TABLE_SIZE];
+static Bitboard rook_table[ROOK_TABLE_SIZE];
+
+static const int bishop_directions[4][2] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+static const int rook_directions[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+
+// Square at `index` offset by `dr` ranks and `df` files, or 0 if that goes off
+// the board.
+static Bitboard offset_square(int index, int dr, int df) {
+    int rank = index / 8 + dr;
+    int file = index % 8 + df;
+    if (rank < 0 || rank > 7 || file < 0 || file > 7)
+        return 0;
+    return BB(rank * 8 + file);
+}
+
+// Slow ray walk, only used to fill the lookup tables
+static Bitboard sliding_attacks(const int directions[4][2], int index, Bitboard occupied) {
+    Bitboard attacks = 0;
+    for (int d = 0; d < 4; d++) {
+        for (int step = 1; ; step++) {
+            Bitboard sq = offset_square(index, directions[d][0] * step, directions[d][1] * step);
+            attacks |= sq;
+            if (!sq || (sq & occupied)) break;
+        }
+    }
+    return attacks;
+}
+
+// xorshift64*, with a fixed seed so that the magics are the same on every run
+static uint64_t xorshift_u64(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// splitmix64, with a fixed seed so that hashes are the same on every run
+static uint64_t splitmix_u64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void init_magics(const int directions[4][2], Magic magics[64], Bitboard* table) {
+    static Bitboard occupancy[4096];
+    static Bitboard reference[4096];
+    static int epoch[4096];
+    static int attempt = 0;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+    for (int index = 0; index < 64; index++) {
+        Magic* m = &magics[index];
+        // Edge squares never block a ray, unless the piece is on that edge
+        Bitboard edges = ((BB_RANK_1 | BB_RANK_8) & ~(BB_RANK_1 << (index / 8 * 8)))
+                       | ((BB_FILE_A | BB_FILE_H) & ~(BB_FILE_A << (index % 8)));
+        m->mask = sliding_attacks(directions, index, 0) & ~edges;
+        m->shift = 64 - bb_count(m->mask);
+        m->attacks = table;
+
+        // Enumerate every subset of the mask with the Carry-Rippler trick
+        int size = 0;
+        Bitboard subset = 0;
+        do {
+            occupancy[size] = subset;
+            reference[size] = sliding_attacks(directions, index, subset);
+            size++;
+            subset = (subset - m->mask) & m->mask;
+        } while (subset);
+        table += size;
+
+#ifdef __BMI2__
+        for (int i = 0; i < size; i++)
+            m->attacks[magic_index(m, occupancy[i])] = reference[i];
+#else
+        // Search for a magic that maps every occupancy to a slot without
+        // destructive collisions.
+        for (int i = 0; i < size; ) {
+            do {
+                m->magic = xorshift_u64(&rng) & xorshift_u64(&rng) & xorshift_u64(&rng);
+            } while (bb_count((m->mask * m->magic) >> 56) < 6);
+
+            attempt++;
+            for (i = 0; i < size; i++) {
+                unsigned idx = magic_index(m, occupancy[i]);
+                if (epoch[idx] < attempt) {
+                    epoch[idx] = attempt;
+                    m->attacks[idx] = reference[i];
+                } else if (m->attacks[idx] != reference[i]) {
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
+
+static void init_attack_tables(void) {
+    static const int knight_offsets[8][2] = {
+        { 2, 1 }, { 2, -1 }, { -2, 1 }, { -2, -1 }, { 1, 2 }, { -1, 2 }, { 1, -2 }, { -1, -2 },
+    };
+    for (int index = 0; index < 64; index++) {
+        for (int i = 0; i < 8; i++)
+            knight_attacks[index] |= offset_square(index, knight_offsets[i][0], knight_offsets[i][1]);
+        for (int dr = -1; dr <= 1; dr++)
+            for (int df = -1; df <= 1; df++)
+                if (dr != 0 || df != 0)
+                    king_attacks[index] |= offset_square(index, dr, df);
+        pawn_attacks[COLOR_WHITE][index] = offset_square(index, 1, 1) | offset_square(index, 1, -1);
+        pawn_attacks[COLOR_BLACK][index] = offset_square(index, -1, 1) | offset_square(index, -1, -1);
+    }
+    init_magics(bishop_directions, bishop_magics, bishop_table);
+    init_magics(rook_directions, rook_magics, rook_table);
+
+    for (int index = 0; index < 64; index++) {
+        bishop_rays[index] = bishop_attacks(index, 0);
+        rook_rays[index] = rook_attacks(index, 0);
+    }
+    for (int a = 0; a < 64; a++) {
+        for (int b = 0; b < 64; b++) {
+            if (a == b) continue;
+            if (bishop_rays[a] & BB(b)) {
+                between_squares[a][b] = bishop_attacks(a, BB(b)) & bishop_attacks(b, BB(a));
+                line_squares[a][b] = (bishop_rays[a] & bishop_rays[b]) | BB(a) | BB(b);
+            } else if (rook_rays[a] & BB(b)) {
+                between_squares[a][b] = rook_attacks(a, BB(b)) & rook_attacks(b, BB(a));
+                line_squares[a][b] = (rook_rays[a] & rook_rays[b]) | BB(a) | BB(b);
+            }
+        }
+    }
+}
+
+static void init_zobrist_keys(void) {
+    uint64_t rng = 0;
+    for (int color = 0; color < 2; color++)
+        for (int kind = 0; kind < NUM_PIECE_KINDS; kind++)
+            for (int index = 0; index < 64; index++)
+                zobrist_pieces[color][kind][index] = splitmix_u64(&rng);
+    // The key of a set of rights is the combination of the key of each right
+    uint64_t rights[4];
+    for (int i = 0; i < 4; i++)
+        rights[i] = splitmix_u64(&rng);
+    for (int set = 0; set < 16; set++) {
+        zobrist_castling[set] = 0;
+        for (int i = 0; i < 4; i++)
+            if (set & (1 << i))
+                zobrist_castling[set] ^= rights[i];
+    }
+    for (int file = 0; file < 8; file++)
+        zobrist_en_passant[file] = splitmix_u64(&rng);
+    zobrist_black_to_move = splitmix_u64(&rng);
+}
+
+// Prints the body of an array initializer, four values per line
+static void print_u64s(const uint64_t* values, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        printf("%s0x%016lxULL,%s", i % 4 == 0 ? "    " : " ", values[i], i % 4 == 3 || i + 1 == count ? "\n" : "");
+}
+
+static void print_array(const char* declaration, const uint64_t* values, size_t count) {
+    printf("%s = {\n", declaration);
+    print_u64s(values, count);
+    printf("};\n\n");
+}
+
+static void print_magics(const char* name, const Magic magics[64], const char* table_name, const Bitboard* table) {
+    printf("const Magic %s[64] = {\n", name);
+    for (int index = 0; index < 64; index++) {
+        const Magic* m = &magics[index];
+        printf("    { 0x%016lxULL, 0x%016lxULL, %s + %ld, %d },\n",
+               m->mask, m->magic, table_name, m->attacks - table, m->shift);
+    }
+    printf("};\n\n");
+}
+
+int main() {
+    init_attack_tables();
+    init_zobrist_keys();
+
+    printf("// Generated by bin/gen_tables.c, do not edit\n\n");
+    printf("#include \"common.h\"\n");
+    printf("#include \"bitboard.h\"\n");
+    printf("#include \"zobrist.h\"\n\n");
+    // The layout of the slider tables depends on how they are indexed
+#ifdef __BMI2__
+    printf("#ifndef __BMI2__\n");
+#else
+    printf("#ifdef __BMI2__\n");
+#endif
+    printf("#error \"attack tables were generated for another target, regenerate them with the same CFLAGS\"\n");
+    printf("#endif\n\n");
+
+    print_array("static const Bitboard bishop_table[" TO_STRING(BISHOP_TABLE_SIZE) "]", bishop_table, BISHOP_TABLE_SIZE);
+    print_array("static const Bitboard rook_table[" TO_STRING(ROOK_TABLE_SIZE) "]", rook_table, ROOK_TABLE_SIZE);
+    print_magics("bishop_magics", bishop_magics, "bishop_table", bishop_table);
+    print_magics("rook_magics", rook_magics, "rook_table", rook_table);
+    print_array("const Bitboard knight_attacks[64]", knight_attacks, 64);
+    print_array("const Bitboard king_attacks[64]", king_attacks, 64);
+    print_array("const Bitboard pawn_attacks[2][64]", &pawn_attacks[0][0], 2 * 64);
+    print_array("const Bitboard bishop_rays[64]", bishop_rays, 64);
+    print_array("const Bitboard rook_rays[64]", rook_rays, 64);
+    print_array("const Bitboard between_squares[64][64]", &between_squares[0][0], 64 * 64);
+    print_array("const Bitboard line_squares[64][64]", &line_squares[0][0], 64 * 64);
+
+    print_array("const uint64_t zobrist_pieces[2][NUM_PIECE_KINDS][64]", &zobrist_pieces[0][0][0], 2 * NUM_PIECE_KINDS * 64);
+    print_array("const uint64_t zobrist_castling[16]", zobrist_castling, 16);
+    print_array("const uint64_t zobrist_en_passant[8]", zobrist_en_passant, 8);
+    printf("const uint64_t zobrist_black_to_move = 0x%016lxULL;\n", zobrist_black_to_move);
+    return EXIT_SUCCESS;
+}
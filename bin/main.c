@@ -9,18 +9,43 @@
 
 #define MAX_GAME_LENGTH 512
 #define MAX_DIR_LENGTH 512
+// Time control of each player when not given, in milliseconds
+#define DEFAULT_BASE_MS 60000
+#define DEFAULT_INCREMENT_MS 1000
 
 static char fen[MAX_FEN_LENGTH + 1];
 static char dir[MAX_DIR_LENGTH + 1];
 static char game[MAX_GAME_LENGTH + 1];
+static TimeControl time_control = {
+    .base_ms = DEFAULT_BASE_MS,
+    .increment_ms = DEFAULT_INCREMENT_MS,
+    .moves = 0,
+};
 
 char const* const DEFAULT_GAME = "game0";
 
 void usage_exit(char* const progname) {
-    fprintf(stderr, "Usage: %s [-f fen] [-g game] DIR\n", progname);
+    fprintf(stderr, "Usage: %s [-f fen] [-g game] [-t base[+increment]] [-m moves] DIR\n", progname);
     exit(EXIT_FAILURE);
 }
 
+// `base[+increment]` in seconds, which may have decimals
+bool parse_time_control(const char* s, TimeControl* tc) {
+    char* endp;
+    double base = strtod(s, &endp);
+    if (endp == s || base <= 0) return false;
+    double increment = 0;
+    if (*endp == '+') {
+        s = endp + 1;
+        increment = strtod(s, &endp);
+        if (endp == s || increment < 0) return false;
+    }
+    if (*endp != '\0') return false;
+    tc->base_ms = base * 1000;
+    tc->increment_ms = increment * 1000;
+    return true;
+}
+
 void parse_args(int argc, char* const argv[]) {
     static struct option const longopts[] = {
         {
@@ -35,6 +60,18 @@ void parse_args(int argc, char* const argv[]) {
             .flag = NULL,
             .val = 0,
         },
+        {
+            .name = "time",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 't',
+        },
+        {
+            .name = "moves",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'm',
+        },
         {0},
     };
 
@@ -42,7 +79,7 @@ void parse_args(int argc, char* const argv[]) {
     strcpy(game, DEFAULT_GAME);
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "f:g:", longopts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "f:g:t:m:", longopts, NULL)) != -1) {
         switch (opt) {
             case 'f':
                 strcpy(fen, optarg);
@@ -56,6 +93,23 @@ void parse_args(int argc, char* const argv[]) {
                 strcpy(game, optarg);
                 break;
 
+            case 't':
+                if (!parse_time_control(optarg, &time_control)) {
+                    fprintf(stderr, "error: invalid time control");
+                    usage_exit(argv[0]);
+                }
+                break;
+
+            case 'm': {
+                char* endp;
+                time_control.moves = strtol(optarg, &endp, 10);
+                if (optarg == endp || *endp != '\0' || time_control.moves < 0) {
+                    fprintf(stderr, "error: invalid number of moves");
+                    usage_exit(argv[0]);
+                }
+                break;
+            }
+
             default: /* '?' */
                 usage_exit(argv[0]);
         }
@@ -83,7 +137,7 @@ int main(int argc, char* const argv[]) {
     puts("~== ENGINE CHESS ==~");
 
     GameServer server;
-    Result res = game_server_init_from_fen(&server, FEN_STARTING);
+    Result res = game_server_init_from_fen(&server, FEN_STARTING, time_control);
     if (res != RESULT_OK) {
         log_error("failed to initialize the game server");
         log_error("%s", get_error_msg(res));
@@ -0,0 +1,252 @@
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "common.h"
+#include "logging.h"
+#include "moves.h"
+#include "fen.h"
+#include "eval.h"
+#include "nnue.h"
+
+#define DEFAULT_REPEAT 10
+
+static const char* path = NULL;
+static const char* net_path = NULL;
+static int repeat = DEFAULT_REPEAT;
+
+void usage_exit(char* const progname) {
+    fprintf(stderr, "Usage: %s -n network -f file [-r repeat]\n", progname);
+    exit(EXIT_FAILURE);
+}
+
+void parse_args(int argc, char* const argv[]) {
+    static struct option const longopts[] = {
+        {
+            .name = "net",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'n',
+        },
+        {
+            .name = "file",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'f',
+        },
+        {
+            .name = "repeat",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'r',
+        },
+        {0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:f:r:", longopts, NULL)) != -1) {
+        switch (opt) {
+            case 'n':
+                net_path = optarg;
+                break;
+
+            case 'f':
+                path = optarg;
+                break;
+
+            case 'r': {
+                char* endp;
+                repeat = strtol(optarg, &endp, 10);
+                if (optarg == endp || repeat < 1) {
+                    log_error("invalid repeat count");
+                    usage_exit(argv[0]);
+                }
+                break;
+            }
+
+            default: /* '?' */
+                usage_exit(argv[0]);
+        }
+    }
+    if (!net_path) {
+        log_error("missing network file");
+        usage_exit(argv[0]);
+    }
+    if (!path) {
+        log_error("missing fen file");
+        usage_exit(argv[0]);
+    }
+    if (optind != argc) {
+        log_error("unexpected arguments");
+        usage_exit(argv[0]);
+    }
+}
+
+double elapsed_seconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Parses one FEN per line, blank lines are skipped
+Result read_games(const char* path, Game** games, size_t* count) {
+    FILE* file = fopen(path, "r");
+    ASSERT_OR(file, LIBC);
+
+    size_t capacity = 1024;
+    *games = malloc(capacity * sizeof(Game));
+    *count = 0;
+    ASSERT_OR(*games, LIBC);
+
+    char* line = NULL;
+    size_t line_size = 0;
+    Result res = RESULT_OK;
+    while (getline(&line, &line_size, file) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        if (*count == capacity) {
+            capacity *= 2;
+            Game* grown = realloc(*games, capacity * sizeof(Game));
+            if (!grown) {
+                res = ERROR(LIBC);
+                break;
+            }
+            *games = grown;
+        }
+        res = parse_fen(&(*games)[*count], line);
+        if (res != RESULT_OK) {
+            log_error("%s: %s", line, get_error_msg(res));
+            break;
+        }
+        (*count)++;
+    }
+    free(line);
+    fclose(file);
+    return res;
+}
+
+// Evaluations per second after each legal move of each game, as the search
+// does them. With `refresh` the accumulator is computed from scratch after the
+// move rather than updated by it. `net` NULL times the piece-square tables.
+double time_evals(Game* games, MoveList* moves, size_t count, const Network* net, bool refresh,
+                  int64_t* checksum) {
+    uint64_t evals = 0;
+    *checksum = 0;
+    Accumulator accumulator;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < count; i++) {
+            Game* game = &games[i];
+            nnue_attach(game, refresh ? NULL : net, &accumulator);
+            for (int m = 0; m < moves[i].count; m++) {
+                MoveHistory hist = make_move(game, moves[i].moves[m]);
+                if (refresh)
+                    nnue_attach(game, net, &accumulator);
+                *checksum += evaluate(game);
+                if (refresh)
+                    nnue_attach(game, NULL, NULL);
+                unmake_move(game, hist);
+            }
+            nnue_attach(game, NULL, NULL);
+            evals += moves[i].count;
+        }
+    }
+    return evals / elapsed_seconds(&start);
+}
+
+// Checks that the accumulators updated by `make_move` and `unmake_move` match
+// the ones computed from scratch, and that both kernels agree on the score.
+// Returns the number of moves that differ.
+size_t check(Game* games, MoveList* moves, size_t count, const Network* net, const Network* scalar_net) {
+    size_t mismatches = 0;
+    Accumulator accumulator, fresh_accumulator;
+    for (size_t i = 0; i < count; i++) {
+        Game* game = &games[i];
+        nnue_attach(game, net, &accumulator);
+        Accumulator before = accumulator;
+        for (int m = 0; m < moves[i].count; m++) {
+            Move move = moves[i].moves[m];
+            MoveHistory hist = make_move(game, move);
+            Game fresh = *game;
+            nnue_attach(&fresh, net, &fresh_accumulator);
+            bool ok = memcmp(&fresh_accumulator, &accumulator, sizeof(Accumulator)) == 0;
+            int score = nnue_evaluate(game);
+            fresh.nnue = scalar_net;
+            ok = ok && nnue_evaluate(&fresh) == score;
+            unmake_move(game, hist);
+            ok = ok && memcmp(&before, &accumulator, sizeof(Accumulator)) == 0;
+            if (!ok) {
+                if (mismatches == 0) {
+                    char fen[MAX_FEN_LENGTH + 1];
+                    char uci[MOVE_UCI_LENGTH];
+                    game_fen(game, fen);
+                    move_to_uci(move, uci);
+                    log_error("%s: accumulator or score differs after %s", fen, uci);
+                }
+                mismatches++;
+            }
+        }
+        nnue_attach(game, NULL, NULL);
+    }
+    return mismatches;
+}
+
+int main(int argc, char* const argv[]) {
+    parse_args(argc, argv);
+
+    Network net;
+    Result res = nnue_load(&net, net_path);
+    if (res != RESULT_OK) {
+        log_error("%s: %s", net_path, get_error_msg(res));
+        return EXIT_FAILURE;
+    }
+    // Same weights, forced onto the portable kernels
+    Network scalar_net = net;
+    scalar_net.avx2 = false;
+
+    Game* games;
+    size_t count;
+    res = read_games(path, &games, &count);
+    if (res != RESULT_OK) {
+        log_error("%s: %s", path, get_error_msg(res));
+        return EXIT_FAILURE;
+    }
+    MoveList* moves = malloc(count * sizeof(MoveList));
+    if (!moves) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    uint64_t total_moves = 0;
+    for (size_t i = 0; i < count; i++)
+        total_moves += all_valid_moves(&games[i], &moves[i]);
+    printf("%zu positions, %lu moves, %d repeats\n", count, total_moves, repeat);
+
+    int64_t checksum;
+    double pst_rate = time_evals(games, moves, count, NULL, false, &checksum);
+    printf("piece-square:       %12.0f evals/s\n", pst_rate);
+
+    const Network* nets[] = { &scalar_net, &net };
+    const char* names[] = { "scalar", "avx2" };
+    for (int k = 0; k < 2; k++) {
+        if (nets[k]->avx2 != (k == 1)) {
+            printf("%-6s:             not supported by this CPU\n", names[k]);
+            continue;
+        }
+        int64_t incremental_checksum, refresh_checksum;
+        double incremental_rate = time_evals(games, moves, count, nets[k], false, &incremental_checksum);
+        double refresh_rate = time_evals(games, moves, count, nets[k], true, &refresh_checksum);
+        printf("%-6s incremental: %12.0f evals/s (%.2fx refresh)\n", names[k], incremental_rate,
+               incremental_rate / refresh_rate);
+        printf("%-6s refresh:     %12.0f evals/s\n", names[k], refresh_rate);
+        if (incremental_checksum != refresh_checksum)
+            log_error("%s: incremental and refreshed scores differ", names[k]);
+    }
+
+    size_t mismatches = check(games, moves, count, &net, &scalar_net);
+    printf("%zu mismatch(es)\n", mismatches);
+    free(moves);
+    free(games);
+    nnue_free(&net);
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
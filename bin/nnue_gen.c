@@ -0,0 +1,72 @@
+// Writes a network in the format of `nnue.h` that counts material, so that the
+// network code can be run and benchmarked without a trained one. Playing with
+// it is weaker than with the piece-square tables.
+//
+// Usage: nnue_gen > material.nnue
+
+#include <string.h>
+
+#include "common.h"
+#include "nnue.h"
+
+// Value of each piece kind in units of 10 centipawns, the king has none
+static const int8_t values[NUM_PIECE_KINDS] = { 10, 32, 33, 50, 90, 0 };
+
+// Each piece on the board adds this much to its neuron
+#define COUNT_WEIGHT 8
+
+static int16_t ft_bias[NNUE_HIDDEN];
+static int16_t ft_weights[NNUE_INPUTS][NNUE_HIDDEN];
+static int32_t l1_bias[NNUE_L1];
+static int8_t l1_weights[NNUE_L1][2 * NNUE_HIDDEN];
+static int32_t l2_bias;
+static int8_t l2_weights[NNUE_L1];
+
+static void write_array(const void* data, size_t size) {
+    if (fwrite(data, 1, size, stdout) != size) {
+        perror("fwrite");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main() {
+    // Neuron `side * NUM_PIECE_KINDS + kind` of the accumulator counts the
+    // pieces of that kind, ours (side 0) or theirs (side 1)
+    for (int side = 0; side < 2; side++)
+        for (int kind = 0; kind < NUM_PIECE_KINDS; kind++)
+            for (int square = 0; square < 64; square++)
+                ft_weights[(side * NUM_PIECE_KINDS + kind) * 64 + square][side * NUM_PIECE_KINDS + kind] = COUNT_WEIGHT;
+
+    // The first dense neuron is how much material we're up, the second how
+    // much we're down, both in units of 20 centipawns. Only the side to move's
+    // accumulator is used.
+    for (int kind = 0; kind < NUM_PIECE_KINDS; kind++) {
+        l1_weights[0][kind] = values[kind];
+        l1_weights[0][NUM_PIECE_KINDS + kind] = -values[kind];
+        l1_weights[1][kind] = -values[kind];
+        l1_weights[1][NUM_PIECE_KINDS + kind] = values[kind];
+    }
+    // Rounds to nearest rather than down
+    l1_bias[0] = l1_bias[1] = 1 << (NNUE_L1_SHIFT - 1);
+    l2_weights[0] = 20;
+    l2_weights[1] = -20;
+
+    char header[NNUE_HEADER_SIZE] = {0};
+    NetworkHeader fields = {
+        .version = NNUE_VERSION,
+        .inputs = NNUE_INPUTS,
+        .hidden = NNUE_HIDDEN,
+        .l1 = NNUE_L1,
+    };
+    memcpy(fields.magic, NNUE_MAGIC, sizeof(fields.magic));
+    memcpy(header, &fields, sizeof(fields));
+
+    write_array(header, sizeof(header));
+    write_array(ft_bias, sizeof(ft_bias));
+    write_array(ft_weights, sizeof(ft_weights));
+    write_array(l1_bias, sizeof(l1_bias));
+    write_array(l1_weights, sizeof(l1_weights));
+    write_array(&l2_bias, sizeof(l2_bias));
+    write_array(l2_weights, sizeof(l2_weights));
+    return EXIT_SUCCESS;
+}
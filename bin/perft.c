@@ -0,0 +1,449 @@
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "common.h"
+#include "logging.h"
+#include "moves.h"
+#include "fen.h"
+#include "thread_pool.h"
+#include "perft_cache.h"
+
+#define DEFAULT_DEPTH 5
+// Subtrees this deep or shallower are walked by a single task
+#define SPLIT_DEPTH 3
+
+typedef struct {
+    const char* name;
+    const char* fen;
+    int depth;
+    uint64_t nodes;
+} PerftCase;
+
+// source: https://www.chessprogramming.org/Perft_Results
+// and the edge cases from http://www.rocechess.ch/perft.html
+static const PerftCase suite[] = {
+    { "startpos",                  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",                 5, 4865609 },
+    { "kiwipete",                  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",     4, 4085603 },
+    { "position 3",                "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",                                5, 674624 },
+    { "position 4",                "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",         4, 422333 },
+    { "position 5",                "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",                3, 62379 },
+    { "position 6",                "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594 },
+    { "illegal en passant 1",      "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",                                        6, 1134888 },
+    { "illegal en passant 2",      "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1",                                       6, 1015133 },
+    { "en passant gives check",    "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",                                      6, 1440467 },
+    { "short castle gives check",  "5k2/8/8/8/8/8/8/4K2R w K - 0 1",                                           6, 661072 },
+    { "long castle gives check",   "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1",                                           6, 803711 },
+    { "castling rights",           "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",                                4, 1274206 },
+    { "castling prevented",        "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",                                 4, 1720476 },
+    { "promote out of check",      "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1",                                        6, 3821001 },
+    { "discovered check",          "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1",                                      5, 1004658 },
+    { "promote to give check",     "4k3/1P6/8/8/8/8/K7/8 w - - 0 1",                                           6, 217342 },
+    { "underpromote to check",     "8/P1k5/K7/8/8/8/8/8 w - - 0 1",                                            6, 92683 },
+    { "self stalemate",            "K1k5/8/P7/8/8/8/8/8 w - - 0 1",                                            6, 2217 },
+    { "stalemate and checkmate 1", "8/k1P5/8/1K6/8/8/8/8 w - - 0 1",                                           7, 567584 },
+    { "stalemate and checkmate 2", "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1",                                        4, 23527 },
+};
+
+typedef struct {
+    const char* name;
+    const char* fen;
+    const char* move;
+    // Position after the move, with its clocks
+    const char* expected;
+} MoveCase;
+
+// What `make_move` does to the parts of the game perft doesn't count
+static const MoveCase move_suite[] = {
+    { "quiet promotion",   "8/P6k/8/8/8/8/8/K7 w - - 99 80",   "a7a8q", "Q7/7k/8/8/8/8/8/K7 b - - 0 80" },
+    { "capture promotion", "1n6/P6k/8/8/8/8/8/K7 w - - 12 80", "a7b8n", "1N6/7k/8/8/8/8/8/K7 b - - 0 80" },
+    { "quiet piece move",  "8/7k/8/8/8/8/8/K7 w - - 12 80",    "a1b1",  "8/7k/8/8/8/8/8/1K6 b - - 13 80" },
+};
+
+static char fen[MAX_FEN_LENGTH + 1];
+static int depth = DEFAULT_DEPTH;
+static bool run_suite = false;
+static int threads = 1;
+static ThreadPool pool;
+// Size of the cache in megabytes, 0 when disabled
+static size_t hash_mb = 0;
+static PerftCache cache;
+// Cache statistics of the current thread, see `flush_cache_stats`
+static _Thread_local uint64_t cache_probes = 0;
+static _Thread_local uint64_t cache_hits = 0;
+
+void usage_exit(char* const progname) {
+    fprintf(stderr, "Usage: %s [-f fen] [-d depth] [-s] [-t threads] [-H megabytes]\n", progname);
+    exit(EXIT_FAILURE);
+}
+
+void parse_args(int argc, char* const argv[]) {
+    static struct option const longopts[] = {
+        {
+            .name = "fen",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'f',
+        },
+        {
+            .name = "depth",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'd',
+        },
+        {
+            .name = "suite",
+            .has_arg = false,
+            .flag = NULL,
+            .val = 's',
+        },
+        {
+            .name = "threads",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 't',
+        },
+        {
+            .name = "hash",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'H',
+        },
+        {0},
+    };
+
+    strcpy(fen, FEN_STARTING);
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:d:st:H:", longopts, NULL)) != -1) {
+        switch (opt) {
+            case 'f':
+                if (strlen(optarg) > MAX_FEN_LENGTH) {
+                    log_error("fen too long");
+                    usage_exit(argv[0]);
+                }
+                strcpy(fen, optarg);
+                break;
+
+            case 'd': {
+                char* endp;
+                depth = strtol(optarg, &endp, 10);
+                if (optarg == endp || depth < 1) {
+                    log_error("invalid depth");
+                    usage_exit(argv[0]);
+                }
+                break;
+            }
+
+            case 's':
+                run_suite = true;
+                break;
+
+            case 't': {
+                char* endp;
+                threads = strtol(optarg, &endp, 10);
+                if (optarg == endp || threads < 1) {
+                    log_error("invalid number of threads");
+                    usage_exit(argv[0]);
+                }
+                break;
+            }
+
+            case 'H': {
+                char* endp;
+                long mb = strtol(optarg, &endp, 10);
+                if (optarg == endp || mb < 0) {
+                    log_error("invalid hash size");
+                    usage_exit(argv[0]);
+                }
+                hash_mb = mb;
+                break;
+            }
+
+            default: /* '?' */
+                usage_exit(argv[0]);
+        }
+    }
+    if (optind != argc) {
+        log_error("unexpected arguments");
+        usage_exit(argv[0]);
+    }
+}
+
+double elapsed_seconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+uint64_t perft(Game* game, int depth) {
+    uint64_t nodes = 0;
+    // Subtrees of depth 1 are cheaper to count than to look up
+    bool cached = hash_mb > 0 && depth > 1;
+    if (cached) {
+        cache_probes++;
+        if (perft_cache_probe(&cache, game->hash, depth, &nodes)) {
+            cache_hits++;
+            return nodes;
+        }
+    }
+
+    MoveList moves;
+    int count = all_valid_moves(game, &moves);
+    // Bulk counting: the leaves are not visited
+    if (depth == 1) return count;
+
+    for (int i = 0; i < count; i++) {
+        MoveHistory hist = make_move(game, moves.moves[i]);
+        nodes += perft(game, depth - 1);
+        unmake_move(game, hist);
+    }
+    if (cached)
+        perft_cache_store(&cache, game->hash, depth, nodes);
+    return nodes;
+}
+
+// Adds the statistics of this thread to the cache's
+void flush_cache_stats() {
+    if (hash_mb > 0)
+        perft_cache_count(&cache, cache_probes, cache_hits);
+    cache_probes = 0;
+    cache_hits = 0;
+}
+
+// A subtree to walk on the thread pool, with its own copy of the game
+typedef struct {
+    Game game;
+    int depth;
+    atomic_uint_least64_t* nodes;
+} PerftTask;
+
+static void perft_task(void* arg) {
+    PerftTask* task = arg;
+    if (task->depth <= SPLIT_DEPTH) {
+        atomic_fetch_add(task->nodes, perft(&task->game, task->depth));
+        flush_cache_stats();
+        free(task);
+        return;
+    }
+
+    MoveList moves;
+    int count = all_valid_moves(&task->game, &moves);
+    for (int i = 0; i < count; i++) {
+        PerftTask* child = malloc(sizeof(PerftTask));
+        if (!child) {
+            perror("perft");
+            exit(EXIT_FAILURE);
+        }
+        child->game = task->game;
+        make_move(&child->game, moves.moves[i]);
+        child->depth = task->depth - 1;
+        child->nodes = task->nodes;
+        thread_pool_submit(&pool, perft_task, child);
+    }
+    free(task);
+}
+
+// Counts the nodes under each of `moves`, the moves of `game`, into
+// `move_nodes`. Uses the thread pool when `parallel`.
+uint64_t perft_moves(Game* game, int depth, MoveList* moves, uint64_t* move_nodes, bool parallel) {
+    static atomic_uint_least64_t counters[MAX_MOVES];
+    uint64_t nodes = 0;
+
+    for (int i = 0; i < moves->count; i++) {
+        if (depth == 1) {
+            move_nodes[i] = 1;
+        } else if (!parallel) {
+            MoveHistory hist = make_move(game, moves->moves[i]);
+            move_nodes[i] = perft(game, depth - 1);
+            unmake_move(game, hist);
+        } else {
+            PerftTask* task = malloc(sizeof(PerftTask));
+            if (!task) {
+                perror("perft");
+                exit(EXIT_FAILURE);
+            }
+            task->game = *game;
+            make_move(&task->game, moves->moves[i]);
+            task->depth = depth - 1;
+            task->nodes = &counters[i];
+            atomic_store(&counters[i], 0);
+            thread_pool_submit(&pool, perft_task, task);
+        }
+    }
+    if (parallel && depth > 1) {
+        thread_pool_wait(&pool);
+        for (int i = 0; i < moves->count; i++)
+            move_nodes[i] = atomic_load(&counters[i]);
+    }
+    flush_cache_stats();
+
+    for (int i = 0; i < moves->count; i++)
+        nodes += move_nodes[i];
+    return nodes;
+}
+
+// Like `perft`, but also prints the node count under each root move
+uint64_t perft_divide(Game* game, int depth) {
+    MoveList moves;
+    uint64_t move_nodes[MAX_MOVES];
+    all_valid_moves(game, &moves);
+    uint64_t nodes = perft_moves(game, depth, &moves, move_nodes, threads > 1);
+
+    for (int i = 0; i < moves.count; i++) {
+        char uci[MOVE_UCI_LENGTH];
+        move_to_uci(moves.moves[i], uci);
+        printf("%s: %lu\n", uci, move_nodes[i]);
+    }
+    return nodes;
+}
+
+// Same as `perft`, but on the thread pool when `parallel`
+uint64_t perft_root(Game* game, int depth, bool parallel) {
+    MoveList moves;
+    uint64_t move_nodes[MAX_MOVES];
+    all_valid_moves(game, &moves);
+    return perft_moves(game, depth, &moves, move_nodes, parallel);
+}
+
+void print_stats(uint64_t nodes, double seconds) {
+    printf("nodes: %lu\n", nodes);
+    printf("time: %.3fs\n", seconds);
+    printf("nps: %.0f\n", seconds > 0 ? nodes / seconds : 0);
+    if (hash_mb > 0) {
+        uint64_t probes = atomic_load(&cache.probes);
+        uint64_t hits = atomic_load(&cache.hits);
+        printf("hash: %zu MB, %lu hits of %lu probes (%.1f%%)\n",
+               perft_cache_size(&cache) / (1024 * 1024), hits, probes, probes > 0 ? 100.0 * hits / probes : 0);
+    }
+}
+
+// Times `perft` on this thread alone, starting with an empty cache as the
+// threaded run did
+double single_thread_seconds(Game* game, int depth) {
+    if (hash_mb > 0)
+        perft_cache_clear(&cache);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    perft(game, depth);
+    double seconds = elapsed_seconds(&start);
+    // Only the threaded runs count towards the statistics
+    cache_probes = 0;
+    cache_hits = 0;
+    return seconds;
+}
+
+// Compares a run on `threads` threads against one on a single thread
+void print_scaling(double seconds, double single_seconds) {
+    double speedup = seconds > 0 ? single_seconds / seconds : 0;
+    printf("1 thread: %.3fs\n", single_seconds);
+    printf("speedup: %.2fx on %d threads\n", speedup, threads);
+    printf("efficiency: %.0f%%\n", 100 * speedup / threads);
+}
+
+int main_suite() {
+    int failures = 0;
+    uint64_t total_nodes = 0;
+    double total_seconds = 0;
+    double single_seconds = 0;
+
+    for (size_t i = 0; i < sizeof(suite) / sizeof(suite[0]); i++) {
+        const PerftCase* test = &suite[i];
+        Game game;
+        Result res = parse_fen(&game, test->fen);
+        if (res != RESULT_OK) {
+            log_error("%s: %s", test->name, get_error_msg(res));
+            failures++;
+            continue;
+        }
+
+        // Every case starts with an empty cache
+        if (hash_mb > 0)
+            perft_cache_clear(&cache);
+        struct timespec case_start;
+        clock_gettime(CLOCK_MONOTONIC, &case_start);
+        uint64_t nodes = perft_root(&game, test->depth, threads > 1);
+        double seconds = elapsed_seconds(&case_start);
+        total_nodes += nodes;
+        total_seconds += seconds;
+
+        if (threads > 1)
+            single_seconds += single_thread_seconds(&game, test->depth);
+
+        bool ok = nodes == test->nodes;
+        if (!ok) failures++;
+        printf("%-4s %-26s depth %d: %10lu nodes (expected %10lu) %8.3fs\n",
+               ok ? "ok" : "FAIL", test->name, test->depth, nodes, test->nodes, seconds);
+    }
+
+    for (size_t i = 0; i < sizeof(move_suite) / sizeof(move_suite[0]); i++) {
+        const MoveCase* test = &move_suite[i];
+        Game game;
+        Move move;
+        char after[MAX_FEN_LENGTH + 1] = "";
+        bool ok = parse_fen(&game, test->fen) == RESULT_OK && parse_move(test->move, &move) == RESULT_OK
+               && is_move_valid(&move, &game);
+        if (ok) {
+            make_move(&game, move);
+            game_fen(&game, after);
+            ok = strcmp(after, test->expected) == 0;
+        }
+        if (!ok) failures++;
+        printf("%-4s %-26s %s: %s (expected %s)\n", ok ? "ok" : "FAIL", test->name, test->move, after,
+               test->expected);
+    }
+
+    print_stats(total_nodes, total_seconds);
+    if (threads > 1)
+        print_scaling(total_seconds, single_seconds);
+    printf("%d failure(s)\n", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main_divide() {
+    Game game;
+    Result res = parse_fen(&game, fen);
+    if (res != RESULT_OK) {
+        log_error("%s", get_error_msg(res));
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t nodes = perft_divide(&game, depth);
+    double seconds = elapsed_seconds(&start);
+
+    printf("\n");
+    print_stats(nodes, seconds);
+    if (threads > 1)
+        print_scaling(seconds, single_thread_seconds(&game, depth));
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* const argv[]) {
+    parse_args(argc, argv);
+
+    if (threads > 1) {
+        Result res = thread_pool_init(&pool, threads);
+        if (res != RESULT_OK) {
+            log_error("thread pool: %s", get_error_msg(res));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (hash_mb > 0) {
+        Result res = perft_cache_init(&cache, hash_mb);
+        if (res != RESULT_OK) {
+            log_error("hash: %s", get_error_msg(res));
+            return EXIT_FAILURE;
+        }
+    }
+
+    int status = run_suite ? main_suite() : main_divide();
+
+    if (threads > 1)
+        thread_pool_destroy(&pool);
+    if (hash_mb > 0)
+        perft_cache_free(&cache);
+    return status;
+}
@@ -0,0 +1,226 @@
+#include <string.h>
+#include <stddef.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "logging.h"
+#include "fen.h"
+#include "search.h"
+#include "tt.h"
+
+#define DEFAULT_DEPTH 6
+#define DEFAULT_HASH 64
+
+static int depth = DEFAULT_DEPTH;
+static int max_threads = 1;
+static size_t hash_mb = DEFAULT_HASH;
+static bool compare_options = false;
+
+void usage_exit(char* const progname) {
+    fprintf(stderr, "Usage: %s [-d depth] [-t threads] [-H megabytes] [-o]\n", progname);
+    exit(EXIT_FAILURE);
+}
+
+void parse_args(int argc, char* const argv[]) {
+    static struct option const longopts[] = {
+        {
+            .name = "depth",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'd',
+        },
+        {
+            .name = "threads",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 't',
+        },
+        {
+            .name = "hash",
+            .has_arg = true,
+            .flag = NULL,
+            .val = 'H',
+        },
+        {
+            .name = "options",
+            .has_arg = false,
+            .flag = NULL,
+            .val = 'o',
+        },
+        {0},
+    };
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    max_threads = cpus > 0 ? cpus : 1;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:t:H:o", longopts, NULL)) != -1) {
+        switch (opt) {
+            case 'd': {
+                char* endp;
+                depth = strtol(optarg, &endp, 10);
+                if (optarg == endp || depth < 1 || depth >= MAX_PLY) {
+                    log_error("invalid depth");
+                    usage_exit(argv[0]);
+                }
+                break;
+            }
+
+            case 't': {
+                char* endp;
+                max_threads = strtol(optarg, &endp, 10);
+                if (optarg == endp || max_threads < 1) {
+                    log_error("invalid number of threads");
+                    usage_exit(argv[0]);
+                }
+                break;
+            }
+
+            case 'H': {
+                char* endp;
+                long mb = strtol(optarg, &endp, 10);
+                if (optarg == endp || mb < 1) {
+                    log_error("invalid hash size");
+                    usage_exit(argv[0]);
+                }
+                hash_mb = mb;
+                break;
+            }
+
+            case 'o':
+                compare_options = true;
+                break;
+
+            default: /* '?' */
+                usage_exit(argv[0]);
+        }
+    }
+    if (optind != argc) {
+        log_error("unexpected arguments");
+        usage_exit(argv[0]);
+    }
+}
+
+double elapsed_seconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Searches every position to `depth` on `threads` threads, each from an empty
+// table, and adds up the time and nodes
+Result run(TranspositionTable* tt, Search* searches, int threads, SearchOptions options,
+           double* seconds, uint64_t* nodes) {
+    *seconds = 0;
+    *nodes = 0;
+    for (size_t i = 0; i < n_bench_positions; i++) {
+        Game game;
+        ASSERT_OK(parse_fen(&game, bench_positions[i]));
+        tt_clear(tt);
+        tt_new_search(tt);
+        for (int t = 0; t < threads; t++) {
+            search_init(&searches[t], &game, (UciGo){ .depth = depth }, tt, NULL);
+            searches[t].options = options;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        search_run_threads(searches, threads);
+        *seconds += elapsed_seconds(&start);
+        *nodes += search_nodes(&searches[0]);
+    }
+    return RESULT_OK;
+}
+
+// Searches on one thread with the techniques of `SearchOptions` turned on one
+// after the other, and compares the nodes to depth with plain alpha-beta
+Result print_options_comparison(TranspositionTable* tt, Search* searches) {
+    static const struct {
+        const char* name;
+        size_t offset;
+    } steps[] = {
+        { "alpha-beta", 0 },
+        { "+ mvv-lva/see", offsetof(SearchOptions, sort_captures) },
+        { "+ quiescence", offsetof(SearchOptions, quiescence) },
+        { "+ killers", offsetof(SearchOptions, killers) },
+        { "+ history", offsetof(SearchOptions, history) },
+        { "+ null move", offsetof(SearchOptions, null_move) },
+        { "+ lmr", offsetof(SearchOptions, late_move_reductions) },
+        { "+ futility", offsetof(SearchOptions, futility) },
+    };
+
+    printf("%-14s %10s %12s %12s %12s\n", "options", "time", "nodes", "nps", "nodes ratio");
+    SearchOptions options = {0};
+    uint64_t plain_nodes = 0;
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        if (i > 0)
+            *(bool*)((char*)&options + steps[i].offset) = true;
+        double seconds;
+        uint64_t nodes;
+        ASSERT_OK(run(tt, searches, 1, options, &seconds, &nodes));
+        if (i == 0) plain_nodes = nodes;
+        printf("%-14s %9.3fs %12lu %12.0f %11.2fx\n", steps[i].name, seconds, nodes,
+               seconds > 0 ? nodes / seconds : 0, (double)nodes / plain_nodes);
+    }
+    return RESULT_OK;
+}
+
+int main(int argc, char* const argv[]) {
+    parse_args(argc, argv);
+
+    TranspositionTable tt;
+    Result res = tt_init(&tt, hash_mb);
+    if (res != RESULT_OK) {
+        log_error("hash: %s", get_error_msg(res));
+        return EXIT_FAILURE;
+    }
+    Search* searches = malloc(max_threads * sizeof(Search));
+    if (!searches) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu positions, depth %d, hash %zu MB\n",
+           n_bench_positions, depth, tt_size(&tt) / (1024 * 1024));
+    if (compare_options) {
+        res = print_options_comparison(&tt, searches);
+        if (res != RESULT_OK) {
+            log_error("%s", get_error_msg(res));
+            return EXIT_FAILURE;
+        }
+        free(searches);
+        tt_free(&tt);
+        return EXIT_SUCCESS;
+    }
+
+    printf("threads %10s %12s %12s %14s %12s\n", "time", "nodes", "nps", "time to depth", "nps scaling");
+
+    double single_seconds = 0;
+    double single_nps = 0;
+    // Powers of two, then `max_threads` itself
+    int threads = 1;
+    for (;;) {
+        double seconds;
+        uint64_t nodes;
+        res = run(&tt, searches, threads, search_default_options, &seconds, &nodes);
+        if (res != RESULT_OK) {
+            log_error("%s", get_error_msg(res));
+            return EXIT_FAILURE;
+        }
+        double nps = seconds > 0 ? nodes / seconds : 0;
+        if (threads == 1) {
+            single_seconds = seconds;
+            single_nps = nps;
+        }
+        printf("%7d %9.3fs %12lu %12.0f %13.2fx %11.2fx\n", threads, seconds, nodes, nps,
+               seconds > 0 ? single_seconds / seconds : 0, single_nps > 0 ? nps / single_nps : 0);
+        if (threads == max_threads) break;
+        threads = threads * 2 < max_threads ? threads * 2 : max_threads;
+    }
+
+    free(searches);
+    tt_free(&tt);
+    return EXIT_SUCCESS;
+}
@@ -12,6 +12,7 @@
 #include "common.h"
 #include "logging.h"
 #include "moves.h"
+#include "bitboard.h"
 #include "fen.h"
 #include "uci.h"
 
@@ -22,9 +23,8 @@ typedef struct {
     PieceColor color;
     bool has_selected;
     Position selected;
-    size_t n_moves;
     bool waiting_move;
-    Move moves[MAX_MOVES];
+    MoveList moves;
 } GameUI;
 
 static char path[MAX_PATH];
@@ -145,31 +145,58 @@ int render_chessboard_inner(FILE* out) {
                 if (res < 0) return res;
                 count += res;
             }
+        }
+    }
 
-            Square* square = board_index(pos, &game->board);
-            if (square->has_piece) {
-                res = fprintf(out, "<g transform=\"translate(%d, %d)\" style=\"pointer-events: none\">", x, y);
-                if (res < 0) return res;
-                count += res;
+    // Pieces are drawn on top of every square, walking only the occupied ones
+    Bitboard pieces = board_occupied(&game->board);
+    while (pieces) {
+        int index = bb_pop_lsb(&pieces);
+        pos = index_position(index);
+        Piece piece = board_piece_at(&game->board, index);
+        int x = pos.file - 'a';
+        int y = ui.color == COLOR_BLACK ? pos.rank - '1' : '8' - pos.rank;
+
+        if (index == game->board.kings[piece.color]
+                && is_square_attacked(game, pos, opposite(piece.color))) {
+            // King in check
+            res = fprintf(out,
+                "<rect "
+                    "x=\"%d\" "
+                    "y=\"%d\" "
+                    "width=\"1\" "
+                    "height=\"1\" "
+                    "fill=\"#ff0000\" "
+                    "fill-opacity=\"0.5\" "
+                    "stroke=\"none\" "
+                    "style=\"pointer-events: none\""
+                "></rect>",
+                x, y
+            );
+            if (res < 0) return res;
+            count += res;
+        }
 
-                res = piece_svg(out, square->piece);
-                if (res < 0) return res;
-                count += res;
+        res = fprintf(out, "<g transform=\"translate(%d, %d)\" style=\"pointer-events: none\">", x, y);
+        if (res < 0) return res;
+        count += res;
 
-                res = fprintf(out, "</g>");
-                if (res < 0) return res;
-                count += res;
-            }
-        }
+        res = piece_svg(out, piece);
+        if (res < 0) return res;
+        count += res;
+
+        res = fprintf(out, "</g>");
+        if (res < 0) return res;
+        count += res;
     }
 
     if (ui.has_selected) {
-        for (int i = 0; i < ui.n_moves; i++) {
-            Position dest = ui.moves[i].destination;
+        for (int i = 0; i < ui.moves.count; i++) {
+            Position dest = index_position(move_destination(ui.moves.moves[i]));
             int x = dest.file - 'a';
             int y = ui.color == COLOR_BLACK ? dest.rank - '1' : '8' - dest.rank;
             Square* square = board_index(dest, &ui.game.board);
-            if (square->has_piece) {
+            if (square_has_piece(*square)) {
                 res = fprintf(out,
                     "<rect "
                         "x=\"%d\" "
@@ -533,23 +560,28 @@ void handle_request(FILE* conn) {
             goto teardown;
         }
         Square* square = board_index(pos, &ui.game.board);
-        if (square->has_piece && square->piece.color == ui.color) {
+        if (square_has_piece(*square) && square_color(*square) == ui.color) {
             ui.has_selected = true;
             ui.selected = pos;
-            ui.n_moves = valid_piece_moves(pos, square->piece, &ui.game, ui.moves);
+            valid_piece_moves(pos, square_piece(*square), &ui.game, &ui.moves);
         } else {
             if (ui.has_selected) {
                 int i;
-                for (i = 0; i < ui.n_moves && !STRUCT_EQ(Position, &ui.moves[i].destination, &pos); i++);
-                if (i < ui.n_moves) {
-                    Move move = {
-                        .origin = ui.selected,
-                        .destination = pos,
-                        .promotion = NO_PROMOTION,
-                    };
+                // Pawns reaching the last rank are always promoted to queens
+                for (i = 0; i < ui.moves.count; i++) {
+                    Move move = ui.moves.moves[i];
+                    char promotion = move_promotion(move);
+                    if (move_destination(move) == position_index(pos)
+                            && (promotion == NO_PROMOTION || promotion == PIECE_QUEEN))
+                        break;
+                }
+                if (i < ui.moves.count) {
+                    Move move = ui.moves.moves[i];
                     if (ui.game.turn == ui.color && ui.waiting_move) {
                         make_move(&ui.game, move);
-                        fprintf(out, "bestmove %.5s\n", (char*)&move);
+                        char uci[MOVE_UCI_LENGTH];
+                        move_to_uci(move, uci);
+                        fprintf(out, "bestmove %s\n", uci);
                         ui.waiting_move = false;
                     }
                 }
@@ -760,7 +792,7 @@ int main(int argc, char* const argv[]) {
                 log_error("%s", get_error_msg(res));
             } else {
                 if (cmd.kind == UCI_POSITION) {
-                    ui.game = cmd.position;
+                    ui.game = cmd.position.game;
                     if (sse) {
                         fprintf(sse, "event: position\n");
                         fprintf(sse, "data: ");
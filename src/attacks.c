@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include "common.h"
+#include "bitboard.h"
+#include "attacks.h"
+
+// Adds one to the count of each square in `attacks` at once, carrying from
+// bit to bit like a binary adder
+static void add_attacks(AttackMap* map, PieceColor color, Bitboard attacks) {
+    Bitboard* count = map->count[color];
+    Bitboard carry = attacks;
+    for (int i = 0; i < ATTACK_COUNT_BITS; i++) {
+        Bitboard bit = count[i];
+        count[i] = bit ^ carry;
+        carry &= bit;
+    }
+    map->by_color[color] |= attacks;
+}
+
+static void remove_attacks(AttackMap* map, PieceColor color, Bitboard attacks) {
+    Bitboard* count = map->count[color];
+    Bitboard borrow = attacks;
+    Bitboard attacked = 0;
+    for (int i = 0; i < ATTACK_COUNT_BITS; i++) {
+        Bitboard bit = count[i];
+        count[i] = bit ^ borrow;
+        borrow &= ~bit;
+        attacked |= count[i];
+    }
+    map->by_color[color] = attacked;
+}
+
+void attack_map_init(Game* game) {
+    Board* board = &game->board;
+    Bitboard occupied = board_occupied(board);
+    memset(&game->attacks, 0, sizeof(game->attacks));
+
+    Bitboard pieces = occupied;
+    while (pieces) {
+        int index = bb_pop_lsb(&pieces);
+        Piece piece = board_piece_at(board, index);
+        add_attacks(&game->attacks, piece.color, piece_attacks_from(piece, index, occupied));
+    }
+}
+
+Bitboard attack_map_remove(Game* game, Bitboard changed) {
+    Board* board = &game->board;
+    Bitboard occupied = board_occupied(board);
+    Bitboard queens = board->kinds[piece_kind_index(PIECE_QUEEN)];
+    Bitboard diagonal = board->kinds[piece_kind_index(PIECE_BISHOP)] | queens;
+    Bitboard straight = board->kinds[piece_kind_index(PIECE_ROOK)] | queens;
+
+    // A slider's rays only change where a square gets or loses a blocker, and
+    // it reaches that square before the move either way.
+    Bitboard sliders = 0;
+    Bitboard squares = changed;
+    while (squares) {
+        int index = bb_pop_lsb(&squares);
+        sliders |= (bishop_attacks(index, occupied) & diagonal) | (rook_attacks(index, occupied) & straight);
+    }
+    sliders &= ~changed;
+
+    Bitboard pieces = (changed & occupied) | sliders;
+    while (pieces) {
+        int index = bb_pop_lsb(&pieces);
+        Piece piece = board_piece_at(board, index);
+        remove_attacks(&game->attacks, piece.color, piece_attacks_from(piece, index, occupied));
+    }
+    return sliders;
+}
+
+void attack_map_add(Game* game, Bitboard changed, Bitboard sliders) {
+    Board* board = &game->board;
+    Bitboard occupied = board_occupied(board);
+    Bitboard pieces = (changed & occupied) | sliders;
+    while (pieces) {
+        int index = bb_pop_lsb(&pieces);
+        Piece piece = board_piece_at(board, index);
+        add_attacks(&game->attacks, piece.color, piece_attacks_from(piece, index, occupied));
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "common.h"
+#include "bitboard.h"
+
+// The attack map of a game is kept up to date by `make_move` and
+// `unmake_move`. A move only changes the attacks of the pieces on the squares
+// it touches and of the sliders that reached those squares, so only those are
+// taken out of the counts before the move and added back after it.
+
+// Squares attacked by `piece` at `index`, sliders are blocked by `occupied`
+static inline Bitboard piece_attacks_from(Piece piece, int index, Bitboard occupied) {
+    switch (piece.kind) {
+        case PIECE_PAWN:   return pawn_attacks[piece.color][index];
+        case PIECE_KNIGHT: return knight_attacks[index];
+        case PIECE_BISHOP: return bishop_attacks(index, occupied);
+        case PIECE_ROOK:   return rook_attacks(index, occupied);
+        case PIECE_QUEEN:  return queen_attacks(index, occupied);
+        case PIECE_KING:   return king_attacks[index];
+    }
+    return 0;
+}
+
+// Pieces of both colors attacking the square at `index`, sliders are blocked
+// by `occupied`
+static inline Bitboard attackers_to(const Board* board, int index, Bitboard occupied) {
+    Bitboard diagonal = board->kinds[piece_kind_index(PIECE_BISHOP)] | board->kinds[piece_kind_index(PIECE_QUEEN)];
+    Bitboard straight = board->kinds[piece_kind_index(PIECE_ROOK)] | board->kinds[piece_kind_index(PIECE_QUEEN)];
+    return (pawn_attacks[COLOR_WHITE][index] & board_pieces(board, COLOR_BLACK, PIECE_PAWN))
+         | (pawn_attacks[COLOR_BLACK][index] & board_pieces(board, COLOR_WHITE, PIECE_PAWN))
+         | (knight_attacks[index] & board->kinds[piece_kind_index(PIECE_KNIGHT)])
+         | (king_attacks[index] & board->kinds[piece_kind_index(PIECE_KING)])
+         | (bishop_attacks(index, occupied) & diagonal)
+         | (rook_attacks(index, occupied) & straight);
+}
+
+// Computes the attack map of `game` from scratch
+void attack_map_init(Game* game);
+
+// Takes out of the map the attacks of the pieces on `changed`, the squares a
+// move is about to fill or empty, and of every slider reaching any of them.
+// Returns the squares of those sliders for `attack_map_add`.
+Bitboard attack_map_remove(Game* game, Bitboard changed);
+
+// Adds back the attacks of the pieces now on `changed` and of `sliders`, once
+// the move is made
+void attack_map_add(Game* game, Bitboard changed, Bitboard sliders);
+
+static inline bool is_attacked_by(const Game* game, int index, PieceColor color) {
+    return game->attacks.by_color[color] & BB(index);
+}
+
+// Number of pieces of `color` attacking the square at `index`
+static inline int attacker_count(const Game* game, int index, PieceColor color) {
+    int count = 0;
+    for (int i = 0; i < ATTACK_COUNT_BITS; i++)
+        count |= ((game->attacks.count[color][i] >> index) & 1) << i;
+    return count;
+}
@@ -0,0 +1,175 @@
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "bitboard.h"
+#include "common.h"
+#include "batch.h"
+
+#define CONCAT_(a, b) a##_##b
+#define CONCAT(a, b) CONCAT_(a, b)
+
+#define BB_FILE_B (BB_FILE_A << 1)
+#define BB_FILE_G (BB_FILE_A << 6)
+
+// Directions a slider may move in, from the point of view of white
+enum {
+    DIR_N, DIR_S, DIR_E, DIR_W, DIR_NE, DIR_NW, DIR_SE, DIR_SW,
+    NUM_DIRS,
+};
+
+// Whether moving in `dir` is a left shift of the bitboard
+static ALWAYS_INLINE bool dir_left(const int dir) {
+    return dir == DIR_N || dir == DIR_E || dir == DIR_NE || dir == DIR_NW;
+}
+
+static ALWAYS_INLINE int dir_amount(const int dir) {
+    switch (dir) {
+        case DIR_N: case DIR_S:   return 8;
+        case DIR_E: case DIR_W:   return 1;
+        case DIR_NE: case DIR_SW: return 9;
+        default:                  return 7;
+    }
+}
+
+// Squares that can't be reached by one step in `dir`, because they would have
+// wrapped around to the other side of the board
+static ALWAYS_INLINE Bitboard dir_mask(const int dir) {
+    switch (dir) {
+        case DIR_E: case DIR_NE: case DIR_SE: return ~BB_FILE_A;
+        case DIR_W: case DIR_NW: case DIR_SW: return ~BB_FILE_H;
+        default:                              return ~(Bitboard)0;
+    }
+}
+
+static ALWAYS_INLINE bool dir_diagonal(const int dir) {
+    return dir >= DIR_NE;
+}
+
+#define LANES 1
+#define SUFFIX scalar
+#include "batch_kernel.h"
+#undef LANES
+#undef SUFFIX
+
+#if defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+// AVX2 has no 64-bit lanes wider than 256 bits, so 4 positions at a time
+#define LANES BATCH_LANES
+#define SUFFIX avx2
+#define KERNEL_AVX2
+#include "batch_kernel.h"
+#undef LANES
+#undef SUFFIX
+#undef KERNEL_AVX2
+#pragma GCC pop_options
+#endif
+
+Result position_batch_init(PositionBatch* this, size_t capacity) {
+    memset(this, 0, sizeof(PositionBatch));
+    this->capacity = (capacity + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+    // Aligned for whole vector loads, zeroed so the positions past `count`
+    // are empty boards
+    size_t size = this->capacity * sizeof(Bitboard);
+    Bitboard** arrays[] = {
+        &this->us, &this->them, &this->en_passant, &this->castling, &this->move_counts,
+        &this->attacks[COLOR_WHITE], &this->attacks[COLOR_BLACK],
+        &this->kinds[0], &this->kinds[1], &this->kinds[2],
+        &this->kinds[3], &this->kinds[4], &this->kinds[5],
+    };
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        *arrays[i] = aligned_alloc(32, size);
+        ASSERT_OR(*arrays[i], LIBC);
+        memset(*arrays[i], 0, size);
+    }
+    this->black_to_move = calloc(this->capacity, sizeof(bool));
+    ASSERT_OR(this->black_to_move, LIBC);
+    return RESULT_OK;
+}
+
+void position_batch_free(PositionBatch* batch) {
+    free(batch->us);
+    free(batch->them);
+    free(batch->en_passant);
+    free(batch->castling);
+    free(batch->move_counts);
+    free(batch->attacks[COLOR_WHITE]);
+    free(batch->attacks[COLOR_BLACK]);
+    for (int i = 0; i < NUM_PIECE_KINDS; i++)
+        free(batch->kinds[i]);
+    free(batch->black_to_move);
+}
+
+void position_batch_add(PositionBatch* batch, const Game* game) {
+    const Board* board = &game->board;
+    PieceColor color = game->turn;
+    bool black = color == COLOR_BLACK;
+    // Flipping the ranks of a bitboard reverses the order of its bytes
+    #define RELATIVE(bb) (black ? __builtin_bswap64(bb) : (bb))
+
+    size_t i = batch->count++;
+    batch->black_to_move[i] = black;
+    batch->us[i] = RELATIVE(board->colors[color]);
+    batch->them[i] = RELATIVE(board->colors[opposite(color)]);
+    for (int kind = 0; kind < NUM_PIECE_KINDS; kind++)
+        batch->kinds[kind][i] = RELATIVE(board->kinds[kind]);
+
+    // Same condition as the move generator: only the side that did not double
+    // push may take en passant
+    batch->en_passant[i] = 0;
+    if (game->double_pushed.has && game->double_pushed.en_passant.rank == (black ? '3' : '6'))
+        batch->en_passant[i] = RELATIVE(BB(position_index(game->double_pushed.en_passant)));
+
+    // After mirroring our rooks always start on a1 and h1
+    Bitboard rooks = batch->us[i] & batch->kinds[piece_kind_index(PIECE_ROOK)][i];
+    Bitboard castling = 0;
+    if (!game->has_king_moved[color]) {
+        if (!game->has_rook_moved[color].kings) castling |= BB(7);
+        if (!game->has_rook_moved[color].queens) castling |= BB(0);
+    }
+    batch->castling[i] = castling & rooks;
+    #undef RELATIVE
+}
+
+// The kernels compute the attacks of the side to move and of its opponent on
+// the mirrored boards, turn them back into the attacks of white and black.
+static void absolute_attacks(PositionBatch* batch) {
+    for (size_t i = 0; i < batch->count; i++) {
+        if (!batch->black_to_move[i]) continue;
+        Bitboard ours = batch->attacks[COLOR_WHITE][i];
+        batch->attacks[COLOR_WHITE][i] = __builtin_bswap64(batch->attacks[COLOR_BLACK][i]);
+        batch->attacks[COLOR_BLACK][i] = __builtin_bswap64(ours);
+    }
+}
+
+void batch_count_moves_scalar(PositionBatch* batch) {
+    count_moves_scalar(batch);
+    absolute_attacks(batch);
+}
+
+#if defined(__x86_64__)
+void batch_count_moves_avx2(PositionBatch* batch) {
+    count_moves_avx2(batch);
+    absolute_attacks(batch);
+}
+#endif
+
+bool batch_has_avx2(void) {
+#if defined(__x86_64__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+void batch_count_moves(PositionBatch* batch) {
+#if defined(__x86_64__)
+    if (batch_has_avx2()) {
+        batch_count_moves_avx2(batch);
+        return;
+    }
+#endif
+    batch_count_moves_scalar(batch);
+}
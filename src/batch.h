@@ -0,0 +1,53 @@
+#pragma once
+
+#include "common.h"
+
+// Positions processed together by one SIMD instruction
+#define BATCH_LANES 4
+
+// Many independent positions in structure of arrays layout, so that the same
+// field of consecutive positions can be loaded at once. Boards are stored from
+// the point of view of the side to move: positions with black to move are
+// mirrored vertically, so that the side to move always plays up the board.
+typedef struct {
+    size_t count;
+    // Always a multiple of BATCH_LANES, positions past `count` are empty
+    size_t capacity;
+    bool* black_to_move;
+    Bitboard* us;
+    Bitboard* them;
+    // Indexed by `piece_kind_index`
+    Bitboard* kinds[NUM_PIECE_KINDS];
+    // En passant target square, or 0 when the side to move can't capture en
+    // passant
+    Bitboard* en_passant;
+    // Squares of the rooks the side to move may still castle with
+    Bitboard* castling;
+
+    // Results of `batch_count_moves`
+    uint64_t* move_counts;
+    // Squares attacked by each color, indexed by PieceColor and not mirrored
+    Bitboard* attacks[2];
+} PositionBatch;
+
+Result position_batch_init(PositionBatch* this, size_t capacity);
+
+void position_batch_free(PositionBatch* batch);
+
+// Appends `game` to the batch, which must not be full
+void position_batch_add(PositionBatch* batch, const Game* game);
+
+// Counts the legal moves of every position and computes the attack sets of
+// both sides, picking the fastest implementation the CPU supports
+void batch_count_moves(PositionBatch* batch);
+
+// Portable implementation, one position at a time
+void batch_count_moves_scalar(PositionBatch* batch);
+
+#if defined(__x86_64__)
+// BATCH_LANES positions at a time, the CPU must support AVX2
+void batch_count_moves_avx2(PositionBatch* batch);
+#endif
+
+// Always false off x86-64, where only the portable code is built
+bool batch_has_avx2(void);
@@ -0,0 +1,237 @@
+// Body of the batch move counter, included by `batch.c` once per instruction
+// set. Before including it define LANES, the number of positions per vector,
+// SUFFIX, appended to every name defined here, and KERNEL_AVX2 when compiling
+// for AVX2.
+//
+// Everything is computed set-wise with shifts and Kogge-Stone fills instead of
+// table lookups, so that every lane runs the exact same instructions. A target
+// square reached by moving in a given direction (or knight offset) comes from
+// exactly one piece, so the moves of all the pieces in that direction can be
+// counted with a single popcount.
+// source: https://www.chessprogramming.org/Kogge-Stone_Algorithm
+
+#define FN(name) CONCAT(name, SUFFIX)
+#define Vec FN(Vec)
+
+typedef uint64_t Vec __attribute__((vector_size(8 * LANES)));
+
+static inline Vec FN(load)(const uint64_t* p) {
+    Vec v;
+    memcpy(&v, p, sizeof(Vec));
+    return v;
+}
+
+static inline void FN(store)(uint64_t* p, Vec v) {
+    memcpy(p, &v, sizeof(Vec));
+}
+
+// All ones in the lanes where `x` isn't 0, 0 elsewhere
+static inline Vec FN(nonzero)(Vec x) {
+    return (Vec)(x != 0);
+}
+
+static inline Vec FN(popcount)(Vec x) {
+#ifdef KERNEL_AVX2
+    // Count the bits of each nibble with a lookup table, then add the bytes
+    // of each lane
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i v = (__m256i)x;
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return (Vec)_mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+#else
+    Vec count;
+    for (int i = 0; i < LANES; i++)
+        count[i] = __builtin_popcountll(x[i]);
+    return count;
+#endif
+}
+
+// Moves every square `n` steps in `dir`, squares wrapping around the board are
+// not dropped.
+static ALWAYS_INLINE Vec FN(shift)(Vec b, const int dir, const int n) {
+    return dir_left(dir) ? b << (dir_amount(dir) * n) : b >> (dir_amount(dir) * n);
+}
+
+// Moves every square one step in `dir`
+static ALWAYS_INLINE Vec FN(step)(Vec b, const int dir) {
+    return FN(shift)(b, dir, 1) & dir_mask(dir);
+}
+
+// Squares attacked in `dir` by the sliders in `sliders`
+static ALWAYS_INLINE Vec FN(ray_attacks)(Vec sliders, Vec empty, const int dir) {
+    Vec pro = empty & dir_mask(dir);
+    sliders |= pro & FN(shift)(sliders, dir, 1);
+    pro &= FN(shift)(pro, dir, 1);
+    sliders |= pro & FN(shift)(sliders, dir, 2);
+    pro &= FN(shift)(pro, dir, 2);
+    sliders |= pro & FN(shift)(sliders, dir, 4);
+    return FN(step)(sliders, dir);
+}
+
+static ALWAYS_INLINE Vec FN(knight_step)(Vec b, const int offset) {
+    switch (offset) {
+        case 0:  return (b << 17) & ~BB_FILE_A;
+        case 1:  return (b << 15) & ~BB_FILE_H;
+        case 2:  return (b << 10) & ~(BB_FILE_A | BB_FILE_B);
+        case 3:  return (b << 6) & ~(BB_FILE_G | BB_FILE_H);
+        case 4:  return (b >> 15) & ~BB_FILE_A;
+        case 5:  return (b >> 17) & ~BB_FILE_H;
+        case 6:  return (b >> 6) & ~(BB_FILE_A | BB_FILE_B);
+        default: return (b >> 10) & ~(BB_FILE_G | BB_FILE_H);
+    }
+}
+
+static inline Vec FN(knight_attacks)(Vec knights) {
+    Vec attacks = knights & 0;
+    for (int offset = 0; offset < 8; offset++)
+        attacks |= FN(knight_step)(knights, offset);
+    return attacks;
+}
+
+static inline Vec FN(king_attacks)(Vec kings) {
+    Vec attacks = kings & 0;
+    for (int dir = 0; dir < NUM_DIRS; dir++)
+        attacks |= FN(step)(kings, dir);
+    return attacks;
+}
+
+// Attacks of every piece in `pieces`, the sliders are blocked by `occupied`
+static inline Vec FN(all_attacks)(Vec pieces, Vec pawns, Vec knights, Vec diagonal, Vec straight, Vec kings, Vec empty, bool up) {
+    pawns &= pieces;
+    Vec attacks = up ? FN(step)(pawns, DIR_NE) | FN(step)(pawns, DIR_NW)
+                     : FN(step)(pawns, DIR_SE) | FN(step)(pawns, DIR_SW);
+    attacks |= FN(knight_attacks)(knights & pieces) | FN(king_attacks)(kings & pieces);
+    for (int dir = 0; dir < NUM_DIRS; dir++)
+        attacks |= FN(ray_attacks)((dir_diagonal(dir) ? diagonal : straight) & pieces, empty, dir);
+    return attacks;
+}
+
+// Moves of the pawns in `pawns` to squares in `allowed`, each move to the last
+// rank counting as the four promotions
+static inline Vec FN(pawn_moves)(Vec pawns, Vec them, Vec empty, Vec allowed) {
+    Vec single = FN(step)(pawns, DIR_N) & empty;
+    Vec twice = FN(step)(single & (BB_RANK_1 << 16), DIR_N) & empty & allowed;
+    single &= allowed;
+    Vec left = FN(step)(pawns, DIR_NW) & them & allowed;
+    Vec right = FN(step)(pawns, DIR_NE) & them & allowed;
+    return FN(popcount)(single) + FN(popcount)(twice) + FN(popcount)(left) + FN(popcount)(right)
+         // Captures from both sides and a push may reach the same promotion
+         // square, so each set is counted on its own
+         + 3 * (FN(popcount)(single & BB_RANK_8) + FN(popcount)(left & BB_RANK_8)
+                + FN(popcount)(right & BB_RANK_8));
+}
+
+static void FN(count_moves)(PositionBatch* batch) {
+    for (size_t i = 0; i < batch->count; i += LANES) {
+        Vec us = FN(load)(batch->us + i);
+        Vec them = FN(load)(batch->them + i);
+        Vec pawns = FN(load)(batch->kinds[piece_kind_index(PIECE_PAWN)] + i);
+        Vec knights = FN(load)(batch->kinds[piece_kind_index(PIECE_KNIGHT)] + i);
+        Vec bishops = FN(load)(batch->kinds[piece_kind_index(PIECE_BISHOP)] + i);
+        Vec rooks = FN(load)(batch->kinds[piece_kind_index(PIECE_ROOK)] + i);
+        Vec queens = FN(load)(batch->kinds[piece_kind_index(PIECE_QUEEN)] + i);
+        Vec kings = FN(load)(batch->kinds[piece_kind_index(PIECE_KING)] + i);
+        Vec en_passant = FN(load)(batch->en_passant + i);
+        Vec castling = FN(load)(batch->castling + i);
+
+        Vec occupied = us | them;
+        Vec empty = ~occupied;
+        Vec king = kings & us;
+        Vec diagonal = bishops | queens;
+        Vec straight = rooks | queens;
+        Vec their_pawns = pawns & them;
+        Vec their_knights = knights & them;
+        Vec their_diagonal = diagonal & them;
+        Vec their_straight = straight & them;
+
+        Vec our_attacks = FN(all_attacks)(us, pawns, knights, diagonal, straight, kings, empty, true);
+        Vec their_attacks = FN(all_attacks)(them, pawns, knights, diagonal, straight, kings, empty, false);
+        // Sliders keep attacking the squares behind the king, so it can't step
+        // back along the line of a check.
+        Vec danger = FN(all_attacks)(them, pawns, knights, diagonal, straight, kings, empty | king, false);
+
+        // Checkers, the squares between the king and a sliding checker, and
+        // the pieces pinned along each direction with their line to the king
+        Vec checkers = (FN(knight_attacks)(king) & their_knights)
+                     | ((FN(step)(king, DIR_NE) | FN(step)(king, DIR_NW)) & their_pawns);
+        Vec check_rays = king & 0;
+        Vec pinned = king & 0;
+        Vec pinned_dir[NUM_DIRS];
+        Vec pin_ray[NUM_DIRS];
+        for (int dir = 0; dir < NUM_DIRS; dir++) {
+            Vec sliders = dir_diagonal(dir) ? their_diagonal : their_straight;
+            Vec ray = FN(ray_attacks)(king, empty, dir);
+            Vec hit = ray & sliders;
+            checkers |= hit;
+            check_rays |= ray & FN(nonzero)(hit);
+
+            Vec blocker = ray & us;
+            Vec xray = FN(ray_attacks)(king, empty | blocker, dir);
+            pinned_dir[dir] = blocker & FN(nonzero)(xray & sliders);
+            pin_ray[dir] = xray & FN(nonzero)(pinned_dir[dir]);
+            pinned |= pinned_dir[dir];
+        }
+        Vec in_check = FN(nonzero)(checkers);
+        Vec double_check = FN(nonzero)(checkers & (checkers - 1));
+        // Where pieces other than the king may go: anywhere out of check,
+        // capture or block in single check and nowhere in double check
+        Vec check_mask = ~in_check | (~double_check & (checkers | check_rays));
+        Vec allowed = ~us & check_mask;
+
+        Vec count = FN(popcount)(FN(king_attacks)(king) & ~us & ~danger);
+
+        // Pinned knights never move
+        Vec free_knights = knights & us & ~pinned;
+        for (int offset = 0; offset < 8; offset++)
+            count += FN(popcount)(FN(knight_step)(free_knights, offset) & allowed);
+
+        for (int dir = 0; dir < NUM_DIRS; dir++) {
+            Vec sliders = (dir_diagonal(dir) ? diagonal : straight) & us;
+            count += FN(popcount)(FN(ray_attacks)(sliders & ~pinned, empty, dir) & allowed);
+            // A pinned slider moving along its pin line may go anywhere up to
+            // and including the pinner
+            count += FN(popcount)(pin_ray[dir] & allowed & FN(nonzero)(pinned_dir[dir] & sliders));
+        }
+
+        Vec our_pawns = pawns & us;
+        count += FN(pawn_moves)(our_pawns & ~pinned, them, empty, allowed);
+        for (int dir = 0; dir < NUM_DIRS; dir++)
+            count += FN(pawn_moves)(our_pawns & pinned_dir[dir], them, empty, allowed & pin_ray[dir]);
+
+        // The king may not castle out of, through or into check
+        Vec kings_side = FN(nonzero)(castling & BB(7))
+                       & ~FN(nonzero)(occupied & (BB(5) | BB(6)))
+                       & ~FN(nonzero)(danger & (BB(5) | BB(6)));
+        Vec queens_side = FN(nonzero)(castling & BB(0))
+                        & ~FN(nonzero)(occupied & (BB(1) | BB(2) | BB(3)))
+                        & ~FN(nonzero)(danger & (BB(2) | BB(3)));
+        count += (kings_side & ~in_check & 1) + (queens_side & ~in_check & 1);
+
+        // En passant removes two pieces from the pawns' rank at once, so just
+        // look for attackers of the king after each of the (at most two)
+        // captures.
+        Vec victim = FN(step)(en_passant, DIR_S);
+        Vec capturers = (FN(step)(en_passant, DIR_SE) | FN(step)(en_passant, DIR_SW)) & our_pawns;
+        Vec other_checkers = checkers & (their_pawns | their_knights) & ~victim;
+        for (int k = 0; k < 2; k++) {
+            Vec pawn = capturers & -capturers;
+            capturers ^= pawn;
+            Vec after = ~((occupied ^ pawn ^ victim) | en_passant);
+            Vec attackers = other_checkers;
+            for (int dir = 0; dir < NUM_DIRS; dir++)
+                attackers |= FN(ray_attacks)(king, after, dir) & (dir_diagonal(dir) ? their_diagonal : their_straight);
+            count += FN(nonzero)(pawn) & ~FN(nonzero)(attackers) & 1;
+        }
+
+        FN(store)(batch->move_counts + i, count);
+        // Still relative to the side to move, see `absolute_attacks`
+        FN(store)(batch->attacks[COLOR_WHITE] + i, our_attacks);
+        FN(store)(batch->attacks[COLOR_BLACK] + i, their_attacks);
+    }
+}
+
+#undef Vec
+#undef FN
@@ -0,0 +1,16 @@
+#include <string.h>
+
+#include "common.h"
+#include "bitboard.h"
+
+// The attack tables are generated at build time by `bin/gen_tables.c`
+
+void board_sync_bitboards(Board* board) {
+    memset(board->colors, 0, sizeof(board->colors));
+    memset(board->kinds, 0, sizeof(board->kinds));
+    for (int index = 0; index < 64; index++) {
+        Square square = board->squares[index / 8][index % 8];
+        if (square_has_piece(square))
+            board_put_piece(board, index, square_piece(square));
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common.h"
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#define BB(index) ((Bitboard)1 << (index))
+
+#define BB_FILE_A 0x0101010101010101ULL
+#define BB_FILE_H (BB_FILE_A << 7)
+#define BB_RANK_1 0xffULL
+#define BB_RANK_8 (BB_RANK_1 << 56)
+
+static inline int bb_lsb(Bitboard bb) {
+    return __builtin_ctzll(bb);
+}
+
+static inline int bb_pop_lsb(Bitboard* bb) {
+    int index = __builtin_ctzll(*bb);
+    *bb &= *bb - 1;
+    return index;
+}
+
+static inline int bb_count(Bitboard bb) {
+    return __builtin_popcountll(bb);
+}
+
+// Sliding piece attacks are looked up in a table indexed by the relevant
+// occupancy bits of the square. With BMI2 those bits are extracted with
+// `pext`, otherwise we use the magic multiplication trick.
+// source: https://www.chessprogramming.org/Magic_Bitboards
+typedef struct {
+    Bitboard mask;
+    Bitboard magic;
+    TABLE_CONST Bitboard* attacks;
+    int shift;
+} Magic;
+
+extern TABLE_CONST Bitboard knight_attacks[64];
+extern TABLE_CONST Bitboard king_attacks[64];
+extern TABLE_CONST Bitboard pawn_attacks[2][64];
+extern TABLE_CONST Magic bishop_magics[64];
+extern TABLE_CONST Magic rook_magics[64];
+// Bishop and rook attacks on an empty board
+extern TABLE_CONST Bitboard bishop_rays[64];
+extern TABLE_CONST Bitboard rook_rays[64];
+// Squares strictly between two squares on the same rank, file or diagonal
+extern TABLE_CONST Bitboard between_squares[64][64];
+// The whole rank, file or diagonal going through two squares
+extern TABLE_CONST Bitboard line_squares[64][64];
+
+static inline unsigned magic_index(const Magic* m, Bitboard occupied) {
+#ifdef __BMI2__
+    return _pext_u64(occupied, m->mask);
+#else
+    return ((occupied & m->mask) * m->magic) >> m->shift;
+#endif
+}
+
+static inline Bitboard bishop_attacks(int index, Bitboard occupied) {
+    const Magic* m = &bishop_magics[index];
+    return m->attacks[magic_index(m, occupied)];
+}
+
+static inline Bitboard rook_attacks(int index, Bitboard occupied) {
+    const Magic* m = &rook_magics[index];
+    return m->attacks[magic_index(m, occupied)];
+}
+
+static inline Bitboard queen_attacks(int index, Bitboard occupied) {
+    return bishop_attacks(index, occupied) | rook_attacks(index, occupied);
+}
+
+static inline Bitboard board_occupied(const Board* board) {
+    return board->colors[COLOR_WHITE] | board->colors[COLOR_BLACK];
+}
+
+static inline Bitboard board_pieces(const Board* board, PieceColor color, PieceKind kind) {
+    return board->colors[color] & board->kinds[piece_kind_index(kind)];
+}
+
+// The following keep `squares`, the bitboards and `kings` in sync
+static inline void board_put_piece(Board* board, int index, Piece piece) {
+    int kind = piece_kind_index(piece.kind);
+    board->squares[index / 8][index % 8] = (kind + 1) | (piece.color << SQUARE_COLOR_SHIFT);
+    board->colors[piece.color] |= BB(index);
+    board->kinds[kind] |= BB(index);
+    if (piece.kind == PIECE_KING)
+        board->kings[piece.color] = index;
+}
+
+static inline void board_remove_piece(Board* board, int index) {
+    Square* square = &board->squares[index / 8][index % 8];
+    board->colors[square_color(*square)] &= ~BB(index);
+    board->kinds[square_kind_index(*square)] &= ~BB(index);
+    *square = SQUARE_EMPTY;
+}
+
+// The piece at `index`, the square must not be empty
+static inline Piece board_piece_at(const Board* board, int index) {
+    return square_piece(board->squares[index / 8][index % 8]);
+}
+
+// Recompute the bitboards from the squares of `board`
+void board_sync_bitboards(Board* board);
@@ -15,6 +15,7 @@ static const char* const error_msg[] = {
     [RESULT_ERR_INVALID_POSITION] = "invalid position",
     [RESULT_ERR_INVALID_PROMOTION] = "invalid promotion",
     [RESULT_ERR_INVALID_PIECE] = "invalid piece",
+    [RESULT_ERR_TIMEOUT] = "timed out",
     [RESULT_ERR_LIBC] = "libc error",
 };
 
@@ -37,10 +38,6 @@ void swap_squares(Square* a, Square* b) {
     *b = tmp;
 }
 
-PieceColor opposite(PieceColor color) {
-    return color == COLOR_WHITE ? COLOR_BLACK : COLOR_WHITE;
-}
-
 char piece_letter(Piece piece) {
     char c = piece.kind;
     if (piece.color == COLOR_WHITE)
@@ -59,17 +56,32 @@ Result piece_from_letter(char letter, Piece* piece) {
 
 Result parse_position(const char* s, Position* out) {
     ASSERT_OR(s && s[0] >= 'a' && s[0] <= 'h'
-                && s[1] >= '0' && s[1] <= '8', INVALID_POSITION);
+                && s[1] >= '1' && s[1] <= '8', INVALID_POSITION);
     *out = MK_POSITION(s);
     return RESULT_OK;
 }
 
 Result parse_move(const char* s, Move* out) {
-    ASSERT_OK(parse_position(s, &out->origin));
+    Position origin, destination;
+    ASSERT_OK(parse_position(s, &origin));
     s += sizeof(Position);
-    ASSERT_OK(parse_position(s, &out->destination));
+    ASSERT_OK(parse_position(s, &destination));
     s += sizeof(Position);
     ASSERT_OR(*s == '\0' || strchr("nbrq", *s), INVALID_PROMOTION);
-    out->promotion = *s;
+    if (*s == '\0')
+        *out = mk_move(position_index(origin), position_index(destination), MOVE_NORMAL);
+    else
+        *out = mk_promotion(position_index(origin), position_index(destination), *s);
     return RESULT_OK;
 }
+
+void move_to_uci(Move move, char* out) {
+    Position origin = index_position(move_origin(move));
+    Position destination = index_position(move_destination(move));
+    *out++ = origin.file;
+    *out++ = origin.rank;
+    *out++ = destination.file;
+    *out++ = destination.rank;
+    *out++ = move_promotion(move);
+    *out = '\0';
+}
@@ -3,9 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
-// No single piece can have more than 32 moves in a turn
-#define MAX_MOVES_PIECE 32
 #define MAX_NUM_PIECES 16
 // Maximum possible number of moves in any turn
 #define MAX_MOVES 218
@@ -17,7 +16,12 @@
 // biggest command is `copyprotection`
 #define UCI_MAX_CMD_SIZE 16
 
+// For code specialized by constant arguments, which only folds away once
+// inlined
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
 static const char* piece_kinds = "pnbrqk";
+#define NUM_PIECE_KINDS 6
 typedef enum {
     PIECE_PAWN   = 'p',
     PIECE_KNIGHT = 'n',
@@ -37,13 +41,37 @@ typedef struct {
     PieceColor color;
 } Piece;
 
-typedef struct {
-    bool has_piece;
-    Piece piece;
-} Square;
+// A square packed in a single byte: 0 when empty, otherwise the index of the
+// piece kind in `piece_kinds` plus one in the low 3 bits and the color in bit
+// 3. Use the `square_*` functions below rather than the bits.
+typedef uint8_t Square;
+
+#define SQUARE_EMPTY ((Square)0)
+#define SQUARE_COLOR_SHIFT 3
+
+// Set of squares, bit `i` stands for the square with index `i` (see
+// `position_index`).
+typedef uint64_t Bitboard;
+
+// Lookup tables are generated at build time and never written afterwards, so
+// they can be shared by any number of threads. Only `bin/gen_tables.c`, which
+// computes them, defines GEN_TABLES.
+#ifdef GEN_TABLES
+#define TABLE_CONST
+#else
+#define TABLE_CONST const
+#endif
 
 typedef struct {
-    Square squares[8][8];
+    // 64 bytes, so the whole mailbox fits a single cache line
+    Square squares[8][8] __attribute__((aligned(64)));
+    // Bitboard form of `squares`, must always be kept in sync with it. Pieces
+    // of a given kind and color are `colors[color] & kinds[kind index]`.
+    Bitboard colors[2];
+    Bitboard kinds[NUM_PIECE_KINDS];
+    // Index of the king of each color. The bitboards above double as the
+    // piece lists, `colors[color]` has at most 16 bits set.
+    int kings[2];
 } Board;
 
 #define INVALID_POSITION MK_POSITION("iv")
@@ -52,37 +80,136 @@ typedef struct {
     char rank;
 } Position;
 
+// Moves are packed in 16 bits:
+//
+//     bits  0-5  index of the origin square
+//     bits  6-11 index of the destination square
+//     bits 12-13 promotion piece, knight to queen, only with MOVE_PROMOTION
+//     bits 14-15 kind of move
+//
+// so that moves can be compared as integers. The castle and en passant kinds
+// can only be told from the position, so moves from `parse_move` never have
+// them, see `check_move`.
+typedef uint16_t Move;
+
+#define MOVE_NORMAL     (0 << 14)
+#define MOVE_PROMOTION  (1 << 14)
+#define MOVE_EN_PASSANT (2 << 14)
+#define MOVE_CASTLE     (3 << 14)
+#define MOVE_KIND_MASK  (3 << 14)
+
+// a1a1, never a valid move
+#define NULL_MOVE ((Move)0)
 #define NO_PROMOTION '\0'
+// UCI long algebraic notation, such as "e7e8q", plus the null terminator
+#define MOVE_UCI_LENGTH 6
+
+static inline Move mk_move(int origin, int destination, int kind) {
+    return origin | (destination << 6) | kind;
+}
+
+static inline Move mk_promotion(int origin, int destination, PieceKind promotion) {
+    int piece = promotion == PIECE_KNIGHT ? 0 : promotion == PIECE_BISHOP ? 1 : promotion == PIECE_ROOK ? 2 : 3;
+    return origin | (destination << 6) | (piece << 12) | MOVE_PROMOTION;
+}
+
+static inline int move_origin(Move move) {
+    return move & 0x3f;
+}
+
+static inline int move_destination(Move move) {
+    return (move >> 6) & 0x3f;
+}
+
+static inline int move_kind(Move move) {
+    return move & MOVE_KIND_MASK;
+}
+
+// The piece kind a pawn is promoted to, or NO_PROMOTION
+static inline char move_promotion(Move move) {
+    if (move_kind(move) != MOVE_PROMOTION) return NO_PROMOTION;
+    return "nbrq"[(move >> 12) & 3];
+}
+
+// Fixed capacity list of moves, enough for any position
 typedef struct {
-    Position origin;
-    Position destination;
-    char promotion; // '\0' if it's not a promotion
-} Move;
+    int count;
+    Move moves[MAX_MOVES];
+} MoveList;
 
-// TODO: en passant + castle
 typedef struct {
-    Move move;
-    bool is_capture;
-    Piece captured;
-    int halfmove_clock;
-} MoveHistory;
+    bool kings;
+    bool queens;
+} RookMoved;
+
+typedef struct {
+    bool has;
+    Position en_passant;
+} DoublePushed;
+
+// Counts up to 31: at most 16 pieces of one color attack a square, the first
+// piece on each of the 8 rays from it and 8 knights
+#define ATTACK_COUNT_BITS 5
+
+// Squares attacked by each color, see `attacks.h`
+typedef struct {
+    // Squares attacked by any piece of each color
+    Bitboard by_color[2];
+    // Number of pieces of each color attacking each square, in binary: bit `i`
+    // of the count of a square is its bit in `count[color][i]`
+    Bitboard count[2][ATTACK_COUNT_BITS];
+} AttackMap;
+
+// Evaluation terms kept up to date by `make_move`, see `eval.h`
+typedef struct {
+    // Material and piece-square values of white minus those of black, in the
+    // middle game and in the endgame
+    int mg;
+    int eg;
+    // From 0 with only pawns and kings left, up to EVAL_MAX_PHASE at the
+    // start, to blend the two scores above
+    int phase;
+} EvalTerms;
+
+// See `nnue.h`
+typedef struct Network Network;
+typedef struct Accumulator Accumulator;
 
 typedef struct {
     PieceColor turn;
     Board board;
     bool has_king_moved[2];
-    struct {
-        bool kings;
-        bool queens;
-    } has_rook_moved[2];
-    struct {
-        bool has;
-        Position en_passant;
-    } double_pushed;
+    RookMoved has_rook_moved[2];
+    DoublePushed double_pushed;
     int halfmove_clock;
     int fullmove_counter;
+    // Zobrist hash of the position, see `zobrist.h`
+    uint64_t hash;
+    EvalTerms eval;
+    AttackMap attacks;
+    // Network evaluating the game, NULL to use the piece-square tables. The
+    // accumulator is kept up to date by `make_move` and `unmake_move` only
+    // while a network is attached, see `nnue_attach`. It lives outside the
+    // game, so that copying a game without a network stays cheap.
+    const Network* nnue;
+    Accumulator* accumulator;
 } Game;
 
+// Everything `unmake_move` needs to restore the game as it was before the
+// move, apart from what can be told from the move itself.
+typedef struct {
+    Move move;
+    // SQUARE_EMPTY unless the move captured on its destination
+    Square captured;
+    bool has_king_moved[2];
+    RookMoved has_rook_moved[2];
+    DoublePushed double_pushed;
+    int halfmove_clock;
+    int fullmove_counter;
+    uint64_t hash;
+    EvalTerms eval;
+} MoveHistory;
+
 #define ERROR(name) RESULT_ERR_##name
 typedef enum {
     RESULT_OK = 0,
@@ -92,6 +219,7 @@ typedef enum {
     RESULT_ERR_INVALID_POSITION,
     RESULT_ERR_INVALID_PROMOTION,
     RESULT_ERR_INVALID_PIECE,
+    RESULT_ERR_TIMEOUT,
     // Check libc's errno in order to get the error
     RESULT_ERR_LIBC,
 } Result;
@@ -99,7 +227,6 @@ typedef enum {
 const char* get_error_msg(Result res);
 
 #define MK_POSITION(s) (*(Position*)s)
-#define MK_MOVE(s) (*(Move*)s)
 
 // #define ASSERT(expr) if (!(expr)) return false
 #define ASSERT_OK(expr) do {  \
@@ -112,11 +239,60 @@ const char* get_error_msg(Result res);
 
 extern const char kings_rank[];
 
+// Squares are indexed from 0 (a1) to 63 (h8), going through files first.
+static inline int position_index(Position position) {
+    return (position.rank - '1') * 8 + (position.file - 'a');
+}
+
+static inline Position index_position(int index) {
+    return (Position){ .file = 'a' + index % 8, .rank = '1' + index / 8 };
+}
+
+// Index of `kind` in `piece_kinds`
+static inline int piece_kind_index(PieceKind kind) {
+    switch (kind) {
+        case PIECE_PAWN:   return 0;
+        case PIECE_KNIGHT: return 1;
+        case PIECE_BISHOP: return 2;
+        case PIECE_ROOK:   return 3;
+        case PIECE_QUEEN:  return 4;
+        case PIECE_KING:   return 5;
+    }
+    return -1;
+}
+
+static inline bool square_has_piece(Square square) {
+    return square != SQUARE_EMPTY;
+}
+
+// Same as `piece_kind_index` of the piece on a square that isn't empty
+static inline int square_kind_index(Square square) {
+    return (square & 7) - 1;
+}
+
+// The piece on a square that isn't empty
+static inline Piece square_piece(Square square) {
+    return (Piece){
+        .kind = piece_kinds[square_kind_index(square)],
+        .color = square >> SQUARE_COLOR_SHIFT,
+    };
+}
+
+static inline PieceColor square_color(Square square) {
+    return square >> SQUARE_COLOR_SHIFT;
+}
+
+static inline Square mk_square(Piece piece) {
+    return (piece_kind_index(piece.kind) + 1) | (piece.color << SQUARE_COLOR_SHIFT);
+}
+
 Square* board_index(Position position, Board* board);
 
 void swap_squares(Square* a, Square* b);
 
-PieceColor opposite(PieceColor color);
+static inline PieceColor opposite(PieceColor color) {
+    return color ^ 1;
+}
 
 char piece_letter(Piece piece);
 
@@ -125,3 +301,6 @@ Result piece_from_letter(char letter, Piece* piece);
 Result parse_position(const char* s, Position* out);
 
 Result parse_move(const char* s, Move* out);
+
+// Writes `move` in UCI notation to `out`, which must fit MOVE_UCI_LENGTH
+void move_to_uci(Move move, char* out);
@@ -0,0 +1,247 @@
+#include "common.h"
+#include "bitboard.h"
+#include "eval.h"
+#include "nnue.h"
+#include "attacks.h"
+
+const int piece_values[NUM_PIECE_KINDS] = { 100, 320, 330, 500, 900, 0 };
+
+const int piece_phase[NUM_PIECE_KINDS] = { 0, 1, 1, 2, 4, 0 };
+
+#define MG_PAWN   82
+#define MG_KNIGHT 337
+#define MG_BISHOP 365
+#define MG_ROOK   477
+#define MG_QUEEN  1025
+
+#define EG_PAWN   94
+#define EG_KNIGHT 281
+#define EG_BISHOP 297
+#define EG_ROOK   512
+#define EG_QUEEN  936
+
+// Adds the value of a piece to every square of its table
+#define P(v) MG_PAWN + (v)
+#define N(v) MG_KNIGHT + (v)
+#define B(v) MG_BISHOP + (v)
+#define R(v) MG_ROOK + (v)
+#define Q(v) MG_QUEEN + (v)
+#define K(v) (v)
+#define RANK(x, a, b, c, d, e, f, g, h) x(a), x(b), x(c), x(d), x(e), x(f), x(g), x(h)
+
+const int16_t piece_square_mg[NUM_PIECE_KINDS][64] = {
+    {
+        RANK(P,   0,   0,   0,   0,   0,   0,   0,   0),
+        RANK(P,  98, 134,  61,  95,  68, 126,  34, -11),
+        RANK(P,  -6,   7,  26,  31,  65,  56,  25, -20),
+        RANK(P, -14,  13,   6,  21,  23,  12,  17, -23),
+        RANK(P, -27,  -2,  -5,  12,  17,   6,  10, -25),
+        RANK(P, -26,  -4,  -4, -10,   3,   3,  33, -12),
+        RANK(P, -35,  -1, -20, -23, -15,  24,  38, -22),
+        RANK(P,   0,   0,   0,   0,   0,   0,   0,   0),
+    },
+    {
+        RANK(N, -167, -89, -34, -49,  61, -97, -15, -107),
+        RANK(N,  -73, -41,  72,  36,  23,  62,   7,  -17),
+        RANK(N,  -47,  60,  37,  65,  84, 129,  73,   44),
+        RANK(N,   -9,  17,  19,  53,  37,  69,  18,   22),
+        RANK(N,  -13,   4,  16,  13,  28,  19,  21,   -8),
+        RANK(N,  -23,  -9,  12,  10,  19,  17,  25,  -16),
+        RANK(N,  -29, -53, -12,  -3,  -1,  18, -14,  -19),
+        RANK(N, -105, -21, -58, -33, -17, -28, -19,  -23),
+    },
+    {
+        RANK(B, -29,   4, -82, -37, -25, -42,   7,  -8),
+        RANK(B, -26,  16, -18, -13,  30,  59,  18, -47),
+        RANK(B, -16,  37,  43,  40,  35,  50,  37,  -2),
+        RANK(B,  -4,   5,  19,  50,  37,  37,   7,  -2),
+        RANK(B,  -6,  13,  13,  26,  34,  12,  10,   4),
+        RANK(B,   0,  15,  15,  15,  14,  27,  18,  10),
+        RANK(B,   4,  15,  16,   0,   7,  21,  33,   1),
+        RANK(B, -33,  -3, -14, -21, -13, -12, -39, -21),
+    },
+    {
+        RANK(R,  32,  42,  32,  51,  63,   9,  31,  43),
+        RANK(R,  27,  32,  58,  62,  80,  67,  26,  44),
+        RANK(R,  -5,  19,  26,  36,  17,  45,  61,  16),
+        RANK(R, -24, -11,   7,  26,  24,  35,  -8, -20),
+        RANK(R, -36, -26, -12,  -1,   9,  -7,   6, -23),
+        RANK(R, -45, -25, -16, -17,   3,   0,  -5, -33),
+        RANK(R, -44, -16, -20,  -9,  -1,  11,  -6, -71),
+        RANK(R, -19, -13,   1,  17,  16,   7, -37, -26),
+    },
+    {
+        RANK(Q, -28,   0,  29,  12,  59,  44,  43,  45),
+        RANK(Q, -24, -39,  -5,   1, -16,  57,  28,  54),
+        RANK(Q, -13, -17,   7,   8,  29,  56,  47,  57),
+        RANK(Q, -27, -27, -16, -16,  -1,  17,  -2,   1),
+        RANK(Q,  -9, -26,  -9, -10,  -2,  -4,   3,  -3),
+        RANK(Q, -14,   2, -11,  -2,  -5,   2,  14,   5),
+        RANK(Q, -35,  -8,  11,   2,   8,  15,  -3,   1),
+        RANK(Q,  -1, -18,  -9,  10, -15, -25, -31, -50),
+    },
+    {
+        RANK(K, -65,  23,  16, -15, -56, -34,   2,  13),
+        RANK(K,  29,  -1, -20,  -7,  -8,  -4, -38, -29),
+        RANK(K,  -9,  24,   2, -16, -20,   6,  22, -22),
+        RANK(K, -17, -20, -12, -27, -30, -25, -14, -36),
+        RANK(K, -49,  -1, -27, -39, -46, -44, -33, -51),
+        RANK(K, -14, -14, -22, -46, -44, -30, -15, -27),
+        RANK(K,   1,   7,  -8, -64, -43, -16,   9,   8),
+        RANK(K, -15,  36,  12, -54,   8, -28,  24,  14),
+    },
+};
+
+#undef P
+#undef N
+#undef B
+#undef R
+#undef Q
+#define P(v) EG_PAWN + (v)
+#define N(v) EG_KNIGHT + (v)
+#define B(v) EG_BISHOP + (v)
+#define R(v) EG_ROOK + (v)
+#define Q(v) EG_QUEEN + (v)
+
+const int16_t piece_square_eg[NUM_PIECE_KINDS][64] = {
+    {
+        RANK(P,   0,   0,   0,   0,   0,   0,   0,   0),
+        RANK(P, 178, 173, 158, 134, 147, 132, 165, 187),
+        RANK(P,  94, 100,  85,  67,  56,  53,  82,  84),
+        RANK(P,  32,  24,  13,   5,  -2,   4,  17,  17),
+        RANK(P,  13,   9,  -3,  -7,  -7,  -8,   3,  -1),
+        RANK(P,   4,   7,  -6,   1,   0,  -5,  -1,  -8),
+        RANK(P,  13,   8,   8,  10,  13,   0,   2,  -7),
+        RANK(P,   0,   0,   0,   0,   0,   0,   0,   0),
+    },
+    {
+        RANK(N, -58, -38, -13, -28, -31, -27, -63, -99),
+        RANK(N, -25,  -8, -25,  -2,  -9, -25, -24, -52),
+        RANK(N, -24, -20,  10,   9,  -1,  -9, -19, -41),
+        RANK(N, -17,   3,  22,  22,  22,  11,   8, -18),
+        RANK(N, -18,  -6,  16,  25,  16,  17,   4, -18),
+        RANK(N, -23,  -3,  -1,  15,  10,  -3, -20, -22),
+        RANK(N, -42, -20, -10,  -5,  -2, -20, -23, -44),
+        RANK(N, -29, -51, -23, -15, -22, -18, -50, -64),
+    },
+    {
+        RANK(B, -14, -21, -11,  -8,  -7,  -9, -17, -24),
+        RANK(B,  -8,  -4,   7, -12,  -3, -13,  -4, -14),
+        RANK(B,   2,  -8,   0,  -1,  -2,   6,   0,   4),
+        RANK(B,  -3,   9,  12,   9,  14,  10,   3,   2),
+        RANK(B,  -6,   3,  13,  19,   7,  10,  -3,  -9),
+        RANK(B, -12,  -3,   8,  10,  13,   3,  -7, -15),
+        RANK(B, -14, -18,  -7,  -1,   4,  -9, -15, -27),
+        RANK(B, -23,  -9, -23,  -5,  -9, -16,  -5, -17),
+    },
+    {
+        RANK(R,  13,  10,  18,  15,  12,  12,   8,   5),
+        RANK(R,  11,  13,  13,  11,  -3,   3,   8,   3),
+        RANK(R,   7,   7,   7,   5,   4,  -3,  -5,  -3),
+        RANK(R,   4,   3,  13,   1,   2,   1,  -1,   2),
+        RANK(R,   3,   5,   8,   4,  -5,  -6,  -8, -11),
+        RANK(R,  -4,   0,  -5,  -1,  -7, -12,  -8, -16),
+        RANK(R,  -6,  -6,   0,   2,  -9,  -9, -11,  -3),
+        RANK(R,  -9,   2,   3,  -1,  -5, -13,   4, -20),
+    },
+    {
+        RANK(Q,  -9,  22,  22,  27,  27,  19,  10,  20),
+        RANK(Q, -17,  20,  32,  41,  58,  25,  30,   0),
+        RANK(Q, -20,   6,   9,  49,  47,  35,  19,   9),
+        RANK(Q,   3,  22,  24,  45,  57,  40,  57,  36),
+        RANK(Q, -18,  28,  19,  47,  31,  34,  39,  23),
+        RANK(Q, -16, -27,  15,   6,   9,  17,  10,   5),
+        RANK(Q, -22, -23, -30, -16, -16, -23, -36, -32),
+        RANK(Q, -33, -28, -22, -43,  -5, -32, -20, -41),
+    },
+    {
+        RANK(K, -74, -35, -18, -18, -11,  15,   4, -17),
+        RANK(K, -12,  17,  14,  17,  17,  38,  23,  11),
+        RANK(K,  10,  17,  23,  15,  20,  45,  44,  13),
+        RANK(K,  -8,  22,  24,  27,  26,  33,  26,   3),
+        RANK(K, -18,  -4,  21,  24,  27,  23,   9, -11),
+        RANK(K, -19,  -3,  11,  21,  23,  16,   7,  -9),
+        RANK(K, -27, -11,   4,  13,  14,   4,  -5, -17),
+        RANK(K, -53, -34, -21, -11, -28, -14, -24, -43),
+    },
+};
+
+// A king may only capture last, or it would be captured back for more than
+// anything it could win
+#define SEE_KING_VALUE 20000
+
+static int see_value(int kind_index) {
+    return kind_index == piece_kind_index(PIECE_KING) ? SEE_KING_VALUE : piece_values[kind_index];
+}
+
+int see(const Game* game, Move move) {
+    const Board* board = &game->board;
+    int origin = move_origin(move);
+    int target = move_destination(move);
+    Bitboard occupied = board_occupied(board) ^ BB(origin);
+
+    // gain[i] is what the side making the i-th capture has won once it's done
+    int gain[32];
+    Square victim = board->squares[target / 8][target % 8];
+    gain[0] = square_has_piece(victim) ? piece_values[square_kind_index(victim)] : 0;
+    int attacker = square_kind_index(board->squares[origin / 8][origin % 8]);
+    if (move_kind(move) == MOVE_EN_PASSANT) {
+        gain[0] = piece_values[piece_kind_index(PIECE_PAWN)];
+        occupied ^= BB((origin & ~7) | (target & 7));
+    } else if (move_kind(move) == MOVE_PROMOTION) {
+        attacker = piece_kind_index(move_promotion(move));
+        gain[0] += piece_values[attacker] - piece_values[piece_kind_index(PIECE_PAWN)];
+    }
+
+    // The sliders behind the moving piece, and behind the pawn taken en
+    // passant, see the target already
+    Bitboard attackers = attackers_to(board, target, occupied);
+    Bitboard queens = board->kinds[piece_kind_index(PIECE_QUEEN)];
+    Bitboard diagonal = board->kinds[piece_kind_index(PIECE_BISHOP)] | queens;
+    Bitboard straight = board->kinds[piece_kind_index(PIECE_ROOK)] | queens;
+    attackers &= occupied;
+
+    PieceColor side = opposite(game->turn);
+    int depth = 0;
+    for (;;) {
+        Bitboard own = attackers & board->colors[side];
+        if (!own) break;
+        int kind = 0;
+        while (!(own & board->kinds[kind])) kind++;
+        depth++;
+        gain[depth] = see_value(attacker) - gain[depth - 1];
+
+        occupied ^= BB(bb_lsb(own & board->kinds[kind]));
+        attackers |= (bishop_attacks(target, occupied) & diagonal) | (rook_attacks(target, occupied) & straight);
+        attackers &= occupied;
+        attacker = kind;
+        side = opposite(side);
+    }
+
+    // Each side may stop capturing when that's better than going on
+    while (depth > 0) {
+        gain[depth - 1] = -(-gain[depth - 1] > gain[depth] ? -gain[depth - 1] : gain[depth]);
+        depth--;
+    }
+    return gain[0];
+}
+
+EvalTerms eval_terms(const Game* game) {
+    EvalTerms terms = {0};
+    for (int index = 0; index < 64; index++) {
+        Square square = game->board.squares[index / 8][index % 8];
+        if (square_has_piece(square))
+            eval_update(&terms, square_color(square), square_kind_index(square), index, 1);
+    }
+    return terms;
+}
+
+int evaluate(const Game* game) {
+    if (game->nnue)
+        return nnue_evaluate(game);
+    const EvalTerms* terms = &game->eval;
+    // Promotions may push the phase past its starting value
+    int phase = terms->phase < EVAL_MAX_PHASE ? terms->phase : EVAL_MAX_PHASE;
+    int score = (terms->mg * phase + terms->eg * (EVAL_MAX_PHASE - phase)) / EVAL_MAX_PHASE;
+    return game->turn == COLOR_WHITE ? score : -score;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.h"
+
+// Phase of a game with every piece on the board, see `EvalTerms`
+#define EVAL_MAX_PHASE 24
+
+// Value of each piece kind in centipawns, indexed by `piece_kind_index`, for
+// weighing exchanges. The king is never captured, so it's worth nothing.
+extern const int piece_values[NUM_PIECE_KINDS];
+
+// Material plus piece-square values of each piece kind on each square, for
+// the middle game and the endgame, from white's point of view. Indexed by the
+// square as seen from the top of the board, so that the tables read like a
+// board with white at the bottom.
+// source: https://www.chessprogramming.org/PeSTO%27s_Evaluation_Function
+extern const int16_t piece_square_mg[NUM_PIECE_KINDS][64];
+extern const int16_t piece_square_eg[NUM_PIECE_KINDS][64];
+// How much each piece kind counts towards the game phase
+extern const int piece_phase[NUM_PIECE_KINDS];
+
+// Adds (`sign` 1) or removes (`sign` -1) a piece of `kind_index` and `color`
+// at `index` to the terms
+static inline void eval_update(EvalTerms* terms, PieceColor color, int kind_index, int index, int sign) {
+    // Black's pieces read the tables upside down and count against white
+    int square = color == COLOR_WHITE ? index ^ 56 : index;
+    int score_sign = color == COLOR_WHITE ? sign : -sign;
+    terms->mg += score_sign * piece_square_mg[kind_index][square];
+    terms->eg += score_sign * piece_square_eg[kind_index][square];
+    terms->phase += sign * piece_phase[kind_index];
+}
+
+static inline void eval_put_piece(EvalTerms* terms, Piece piece, int index) {
+    eval_update(terms, piece.color, piece_kind_index(piece.kind), index, 1);
+}
+
+// The piece on a square that isn't empty leaves it
+static inline void eval_remove_square(EvalTerms* terms, Square square, int index) {
+    eval_update(terms, square_color(square), square_kind_index(square), index, -1);
+}
+
+// Static exchange evaluation: the material the side to move wins, in
+// centipawns, when `move` captures on its destination and both sides then keep
+// recapturing there with their least valuable piece for as long as it pays.
+// Pins are ignored.
+// source: https://www.chessprogramming.org/Static_Exchange_Evaluation
+int see(const Game* game, Move move);
+
+// Computes the terms of `game` from scratch
+EvalTerms eval_terms(const Game* game);
+
+// Score of the position from the point of view of the side to move, in
+// centipawns. Only reads the terms kept up to date by `make_move`, or the
+// accumulator when a network is attached with `nnue_attach`.
+int evaluate(const Game* game);
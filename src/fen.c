@@ -30,6 +30,10 @@
 //
 
 #include "common.h"
+#include "bitboard.h"
+#include "zobrist.h"
+#include "attacks.h"
+#include "eval.h"
 
 const char* FEN_STARTING = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
@@ -50,12 +54,12 @@ void game_fen(Game* game, char* out) {
         int consecutive_spaces = 0;
         for (pos.file = 'a'; pos.file <= 'h'; pos.file++) {
             Square* square = board_index(pos, &game->board);
-            if (square->has_piece) {
+            if (square_has_piece(*square)) {
                 if (consecutive_spaces != 0) {
                     *out++ = consecutive_spaces + '0';
                     consecutive_spaces = 0;
                 }
-                *out++ = piece_letter(square->piece);
+                *out++ = piece_letter(square_piece(*square));
             } else {
                 consecutive_spaces++;
             }
@@ -119,15 +123,20 @@ Result parse_fen(Game* this, const char* fen) {
                 if (consecutive_spaces == 0) {
                     consecutive_spaces = *fen++ - '0';
                 }
-                square->has_piece = false;
+                *square = SQUARE_EMPTY;
                 consecutive_spaces--;
             } else {
-                square->has_piece = true;
-                ASSERT_OK(piece_from_letter(*fen++, &square->piece));
+                Piece piece;
+                ASSERT_OK(piece_from_letter(*fen++, &piece));
+                *square = mk_square(piece);
             }
         }
         ASSERT_OR(pos.rank == '1' || *fen++ == '/', INVALID_FEN);
     }
+    board_sync_bitboards(&this->board);
+    // Move generation relies on each side having exactly one king
+    for (PieceColor color = COLOR_WHITE; color <= COLOR_BLACK; color++)
+        ASSERT_OR(bb_count(board_pieces(&this->board, color, PIECE_KING)) == 1, INVALID_FEN);
     ASSERT_OR(*fen++ == ' ', INVALID_FEN);
 
     char side_to_move = *(fen++);
@@ -141,11 +150,11 @@ Result parse_fen(Game* this, const char* fen) {
             ASSERT_OK(piece_from_letter(*fen++, &piece));
             this->has_king_moved[piece.color] = false;
             if (piece.kind == PIECE_KING)
-                this->has_rook_moved[piece.color].kings = true;
+                this->has_rook_moved[piece.color].kings = false;
             else if (piece.kind == PIECE_QUEEN)
-                this->has_rook_moved[piece.color].queens = true;
+                this->has_rook_moved[piece.color].queens = false;
             else
-                return false;
+                return ERROR(INVALID_FEN);
         }
     } else {
         fen++;
@@ -170,5 +179,10 @@ Result parse_fen(Game* this, const char* fen) {
     fen += count;
     ASSERT_OR(*fen == '\0', INVALID_FEN);
 
+    this->hash = zobrist_hash(this);
+    this->eval = eval_terms(this);
+    this->nnue = NULL;
+    this->accumulator = NULL;
+    attack_map_init(this);
     return RESULT_OK;
 }
@@ -1,4 +1,8 @@
 #include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <limits.h>
+#include <errno.h>
 
 #include "logging.h"
 #include "game_server.h"
@@ -7,6 +11,9 @@
 #include "fen.h"
 #include "moves.h"
 
+// How long a player sent `stop` has to answer with its move
+#define STOP_TIMEOUT_MS 1000
+
 Result player_init(Player* this) {
     this->linebuf = NULL;
     this->linecap = 0;
@@ -21,8 +28,15 @@ void player_deinit(Player* this) {
     if (this->out) fclose(this->out);
 }
 
-Result game_server_init_from_fen(GameServer* this, const char* fen) {
+Result game_server_init_from_fen(GameServer* this, const char* fen, TimeControl time_control) {
     this->ai_color = COLOR_BLACK;
+    this->time_control = time_control;
+    for (PieceColor color = COLOR_WHITE; color <= COLOR_BLACK; color++) {
+        this->clocks[color] = time_control.base_ms;
+        this->moves_made[color] = 0;
+        this->pondering[color] = false;
+    }
+    this->last_move = NULL_MOVE;
     ASSERT_OK(parse_fen(&this->game, fen));
     this->is_startpos = true;
     this->is_done = false;
@@ -45,9 +59,35 @@ Result player_uci_read(Player* player, UciCommand* cmd) {
     return uci_parse_command(player->linebuf, cmd);
 }
 
-Result player_uci_read_until_kind(Player* player, UciCommandKind kind, UciCommand* out) {
+static int64_t elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+// Waits for a line from the player for at most `timeout_ms`, forever when
+// negative. The stream is unbuffered, so nothing read is left waiting in it.
+static Result player_poll(Player* player, const struct timespec* start, int64_t timeout_ms) {
+    while (timeout_ms >= 0) {
+        int64_t left = timeout_ms - elapsed_ms(start);
+        if (left <= 0) return ERROR(TIMEOUT);
+        struct pollfd fd = { .fd = fileno(player->in), .events = POLLIN };
+        int ready = poll(&fd, 1, left > INT_MAX ? INT_MAX : left);
+        if (ready > 0) break;
+        ASSERT_OR(ready == 0 || errno == EINTR, LIBC);
+    }
+    return RESULT_OK;
+}
+
+// Skips the player's commands until one of `kind`, failing with
+// RESULT_ERR_TIMEOUT if none comes within `timeout_ms`, forever when negative
+Result player_uci_read_until_kind_timeout(Player* player, UciCommandKind kind, UciCommand* out,
+                                          int64_t timeout_ms) {
     log_debug("waiting %s", uci_command_kind_to_string[kind]);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     while (1) {
+        ASSERT_OK(player_poll(player, &start, timeout_ms));
         UciCommand cmd;
         Result res = player_uci_read(player, &cmd);
         if (res != RESULT_OK) {
@@ -63,6 +103,10 @@ Result player_uci_read_until_kind(Player* player, UciCommandKind kind, UciComman
     }
 }
 
+Result player_uci_read_until_kind(Player* player, UciCommandKind kind, UciCommand* out) {
+    return player_uci_read_until_kind_timeout(player, kind, out, -1);
+}
+
 Result player_uci_handshake(Player* player) {
     ASSERT_OR(fprintf(player->out, "uci\n") >= 0, LIBC);
     ASSERT_OK(player_uci_read_until_kind(player, UCI_OK, NULL));
@@ -79,40 +123,142 @@ Result game_server_setup_uci(GameServer* server) {
     return RESULT_OK;
 }
 
+// Sends `go` with both clocks, for `color` to move
+static Result player_go(GameServer* server, Player* player, PieceColor color, bool ponder) {
+    const TimeControl* tc = &server->time_control;
+    ASSERT_OR(fprintf(player->out, "go %swtime %ld btime %ld winc %ld binc %ld", ponder ? "ponder " : "",
+                      server->clocks[COLOR_WHITE], server->clocks[COLOR_BLACK],
+                      tc->increment_ms, tc->increment_ms) >= 0, LIBC);
+    if (tc->moves > 0) {
+        int moves_to_go = tc->moves - server->moves_made[color] % tc->moves;
+        ASSERT_OR(fprintf(player->out, " movestogo %d", moves_to_go) >= 0, LIBC);
+    }
+    ASSERT_OR(fprintf(player->out, "\n") >= 0, LIBC);
+    return RESULT_OK;
+}
+
+// Has the player of `color`, the side that just moved, search the position
+// after the reply it expects until the opponent moves
+static Result player_ponder(GameServer* server, PieceColor color, Move reply) {
+    char fen[MAX_FEN_LENGTH + 1];
+    char uci[MOVE_UCI_LENGTH];
+    if (!is_move_valid(&reply, &server->game)) return RESULT_OK;
+    Player* player = &server->players[color];
+    game_fen(&server->game, fen);
+    move_to_uci(reply, uci);
+    ASSERT_OR(fprintf(player->out, "position fen %s moves %s\n", fen, uci) >= 0, LIBC);
+    ASSERT_OK(player_go(server, player, color, true));
+    server->pondering[color] = true;
+    server->ponder_move[color] = reply;
+    return RESULT_OK;
+}
+
+// Stops the search of the player and discards the move it answers with. One
+// that doesn't answer within STOP_TIMEOUT_MS isn't waited for any longer.
+static Result player_stop(Player* player) {
+    ASSERT_OR(fprintf(player->out, "stop\n") >= 0, LIBC);
+    Result res = player_uci_read_until_kind_timeout(player, UCI_BESTMOVE, NULL, STOP_TIMEOUT_MS);
+    if (res == RESULT_ERR_TIMEOUT) {
+        log_error("no answer to stop");
+        return RESULT_OK;
+    }
+    return res;
+}
+
+// Ends the ponder search of the player of `color`, if any
+static Result player_stop_pondering(GameServer* server, PieceColor color) {
+    if (!server->pondering[color]) return RESULT_OK;
+    server->pondering[color] = false;
+    return player_stop(&server->players[color]);
+}
+
+// Credits the side to move with the increment of the move it just made, and
+// with the next period's time once it made enough moves
+static void credit_clock(GameServer* server) {
+    const TimeControl* tc = &server->time_control;
+    PieceColor color = server->game.turn;
+    server->clocks[color] += tc->increment_ms;
+    server->moves_made[color]++;
+    if (tc->moves > 0 && server->moves_made[color] % tc->moves == 0)
+        server->clocks[color] += tc->base_ms;
+}
+
 Result game_server_update(GameServer* server) {
     Game* game = &server->game;
     Player* player = &server->players[game->turn];
 
-    Move possible_moves[MAX_MOVES];
-    memset(possible_moves, 0, sizeof(possible_moves));
-    int count = all_valid_moves(game, possible_moves);
-    if (count == 0) {
-        server->is_done = true;
-        log_info("%s wins", opposite(game->turn) == COLOR_WHITE ? "white" : "black");
-        return RESULT_OK;
+    switch (game_status(game)) {
+        case GAME_CHECKMATE:
+            server->is_done = true;
+            log_info("checkmate, %s wins", opposite(game->turn) == COLOR_WHITE ? "white" : "black");
+            return player_stop_pondering(server, game->turn);
+
+        case GAME_STALEMATE:
+            server->is_done = true;
+            log_info("stalemate, the game is drawn");
+            return player_stop_pondering(server, game->turn);
+
+        case GAME_ONGOING:
+            break;
+    }
+
+    if (is_in_check(game)) {
+        log_info("%s is in check", game->turn == COLOR_WHITE ? "white" : "black");
     }
 
     char fen[MAX_FEN_LENGTH + 1];
     game_fen(game, fen);
 
-    if (server->is_startpos) {
-        ASSERT_OR(fprintf(player->out, "position startpos\n") >= 0, LIBC);
-        server->is_startpos = false;
+    // The clock runs from the `go`, or the `ponderhit`, to the `bestmove`
+    struct timespec start;
+    if (server->pondering[game->turn] && server->ponder_move[game->turn] == server->last_move) {
+        server->pondering[game->turn] = false;
+        log_debug("ponderhit");
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ASSERT_OR(fprintf(player->out, "ponderhit\n") >= 0, LIBC);
     } else {
-        ASSERT_OR(fprintf(player->out, "position fen %s\n", fen) >= 0, LIBC);
+        ASSERT_OK(player_stop_pondering(server, game->turn));
+        if (server->is_startpos) {
+            ASSERT_OR(fprintf(player->out, "position startpos\n") >= 0, LIBC);
+        } else {
+            ASSERT_OR(fprintf(player->out, "position fen %s\n", fen) >= 0, LIBC);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ASSERT_OK(player_go(server, player, game->turn, false));
     }
-    ASSERT_OR(fprintf(player->out, "go depth 10\n") >= 0, LIBC);
+    server->is_startpos = false;
 
+    // A player that doesn't answer in time loses without being waited for
     UciCommand cmd;
-    ASSERT_OK(player_uci_read_until_kind(player, UCI_BESTMOVE, &cmd));
+    Result res = player_uci_read_until_kind_timeout(player, UCI_BESTMOVE, &cmd,
+                                                    server->clocks[game->turn] + 1);
+    if (res != RESULT_OK && res != RESULT_ERR_TIMEOUT) return res;
+    server->clocks[game->turn] -= elapsed_ms(&start);
+    if (res == RESULT_ERR_TIMEOUT || server->clocks[game->turn] < 0) {
+        server->is_done = true;
+        log_info("%s ran out of time, %s wins", game->turn == COLOR_WHITE ? "white" : "black",
+                 game->turn == COLOR_WHITE ? "black" : "white");
+        // Still searching, its late move is read and thrown away
+        if (res == RESULT_ERR_TIMEOUT)
+            ASSERT_OK(player_stop(player));
+        return player_stop_pondering(server, opposite(game->turn));
+    }
     Move move = cmd.bestmove.move;
-    if (!check_move(move, &server->game, possible_moves, count)) {
-        log_error("invalid move %.5s", (char*)&move);
+    if (!is_move_valid(&move, game)) {
+        char uci[MOVE_UCI_LENGTH];
+        move_to_uci(move, uci);
+        log_error("invalid move %s", uci);
         return RESULT_OK;
     }
-    int history_slot = server->game.fullmove_counter % HISTORY_MAX;
+    int ply = 2 * (game->fullmove_counter - 1) + game->turn;
+    int history_slot = ply % HISTORY_MAX;
+    credit_clock(server);
+    PieceColor color = game->turn;
     server->history[history_slot] = make_move(&server->game, move);
-
-    game->turn = opposite(game->turn);
+    server->last_move = move;
+    log_info("clocks: white %.1fs, black %.1fs",
+             server->clocks[COLOR_WHITE] / 1000.0, server->clocks[COLOR_BLACK] / 1000.0);
+    if (cmd.bestmove.has_ponder)
+        ASSERT_OK(player_ponder(server, color, cmd.bestmove.ponder));
     return RESULT_OK;
 }
@@ -10,6 +10,15 @@ typedef struct {
     FILE* out;
 } Player;
 
+// Each player starts with `base_ms` on their clock and gains `increment_ms`
+// after each of their moves. With `moves` set, `base_ms` is added again every
+// `moves` moves, otherwise it lasts the whole game.
+typedef struct {
+    int64_t base_ms;
+    int64_t increment_ms;
+    int moves;
+} TimeControl;
+
 typedef struct {
     MoveHistory history[HISTORY_MAX];
     PieceColor ai_color;
@@ -17,9 +26,18 @@ typedef struct {
     bool is_startpos;
     bool is_done;
     Player players[2];
+    TimeControl time_control;
+    // Milliseconds left to each player
+    int64_t clocks[2];
+    int moves_made[2];
+    // A player that answered `bestmove <move> ponder <reply>` searches the
+    // position after `reply` on the opponent's time, until the opponent moves
+    bool pondering[2];
+    Move ponder_move[2];
+    Move last_move;
 } GameServer;
 
-Result game_server_init_from_fen(GameServer* server, const char* fen);
+Result game_server_init_from_fen(GameServer* server, const char* fen, TimeControl time_control);
 
 void game_server_deinit(GameServer* server);
 
@@ -3,558 +3,662 @@
 
 #include "common.h"
 #include "moves.h"
+#include "bitboard.h"
+#include "zobrist.h"
+#include "attacks.h"
+#include "eval.h"
+#include "nnue.h"
+
+// Castling rights are lost once the king or the rook leaves its square, or
+// when the rook is captured.
+static void update_castling_rights(Game* game, int index) {
+    for (PieceColor color = COLOR_WHITE; color <= COLOR_BLACK; color++) {
+        int base = position_index((Position){ .file = 'a', .rank = kings_rank[color] });
+        if (index == base + 4)
+            game->has_king_moved[color] = true;
+        else if (index == base + 7)
+            game->has_rook_moved[color].kings = true;
+        else if (index == base)
+            game->has_rook_moved[color].queens = true;
+    }
+}
 
-MoveHistory make_move(Game* game, Move move) {
-    Square* square;
+// Like `board_put_piece` and `board_remove_piece`, also updating the network's
+// accumulator. `unmake_move` uses these, the other terms come back from the
+// history.
+static void restore_piece(Game* game, int index, Piece piece) {
+    board_put_piece(&game->board, index, piece);
+    if (game->nnue)
+        nnue_add_piece(game, piece, index);
+}
+
+static void unplace_piece(Game* game, int index) {
+    if (game->nnue)
+        nnue_remove_piece(game, board_piece_at(&game->board, index), index);
+    board_remove_piece(&game->board, index);
+}
 
-    square = board_index(move.origin, &game->board);
-    assert(square->has_piece);
-    square->has_piece = false;
-    Piece piece = square->piece;
+// Like `restore_piece` and `unplace_piece`, also updating the hash and the
+// evaluation terms
+static void put_piece(Game* game, int index, Piece piece) {
+    restore_piece(game, index, piece);
+    game->hash ^= zobrist_piece(piece, index);
+    eval_put_piece(&game->eval, piece, index);
+}
 
-    square = board_index(move.destination, &game->board);
+static void remove_piece(Game* game, int index) {
+    Square square = game->board.squares[index / 8][index % 8];
+    game->hash ^= zobrist_square(square, index);
+    eval_remove_square(&game->eval, square, index);
+    unplace_piece(game, index);
+}
+
+// The pawn taken en passant is beside the origin, on the destination's file
+static int en_passant_victim(Move move) {
+    return (move_origin(move) & ~7) | (move_destination(move) & 7);
+}
+
+// Squares of the rook of a castle, before and after it
+static void castle_rook(Move move, int* rook, int* rook_dest) {
+    int king = move_origin(move);
+    bool kings_side = move_destination(move) > king;
+    *rook = kings_side ? king + 3 : king - 4;
+    *rook_dest = kings_side ? king + 1 : king - 1;
+}
+
+// Squares that get or lose a piece when playing `move`
+static Bitboard move_squares(Move move) {
+    Bitboard squares = BB(move_origin(move)) | BB(move_destination(move));
+    if (move_kind(move) == MOVE_EN_PASSANT) {
+        squares |= BB(en_passant_victim(move));
+    } else if (move_kind(move) == MOVE_CASTLE) {
+        int rook, rook_dest;
+        castle_rook(move, &rook, &rook_dest);
+        squares |= BB(rook) | BB(rook_dest);
+    }
+    return squares;
+}
+
+MoveHistory make_move(Game* game, Move move) {
+    Board* board = &game->board;
+    int origin = move_origin(move);
+    int destination = move_destination(move);
+
+    assert(square_has_piece(board->squares[origin / 8][origin % 8]));
+    Piece piece = board_piece_at(board, origin);
 
     MoveHistory hist;
     hist.move = move;
-    hist.is_capture = square->has_piece;
-    hist.captured = square->piece;
+    hist.captured = board->squares[destination / 8][destination % 8];
+    memcpy(hist.has_king_moved, game->has_king_moved, sizeof(hist.has_king_moved));
+    memcpy(hist.has_rook_moved, game->has_rook_moved, sizeof(hist.has_rook_moved));
+    hist.double_pushed = game->double_pushed;
     hist.halfmove_clock = game->halfmove_clock;
-
-    square->has_piece = true;
-    if (move.promotion != '\0') {
-        piece.kind = move.promotion;
-    }
-    square->piece = piece;
-
-    if (hist.is_capture || piece.kind == PIECE_PAWN) {
+    hist.fullmove_counter = game->fullmove_counter;
+    hist.hash = game->hash;
+    hist.eval = game->eval;
+
+    // Castling and en passant are hashed back in once updated
+    game->hash ^= zobrist_castling[castling_rights(game)];
+    if (game->double_pushed.has)
+        game->hash ^= zobrist_en_passant[game->double_pushed.en_passant.file - 'a'];
+
+    Bitboard changed = move_squares(move);
+    Bitboard sliders = attack_map_remove(game, changed);
+    if (square_has_piece(hist.captured)) {
+        remove_piece(game, destination);
+    } else if (move_kind(move) == MOVE_EN_PASSANT) {
+        remove_piece(game, en_passant_victim(move));
+    }
+    remove_piece(game, origin);
+    // Before a promotion changes the kind
+    bool pawn_move = piece.kind == PIECE_PAWN;
+    if (move_kind(move) == MOVE_PROMOTION) {
+        piece.kind = move_promotion(move);
+    }
+    put_piece(game, destination, piece);
+
+    if (square_has_piece(hist.captured) || pawn_move) {
         game->halfmove_clock = 0;
     } else {
         game->halfmove_clock++;
     }
     // Default is false
     game->double_pushed.has = false;
-    if (piece.kind == PIECE_KING) {
-        game->has_king_moved[piece.color] = true;
-        int offset = move.destination.file - move.origin.file;
-        if (abs(offset) == 2) {
-            // Must be a castle
-            if (offset > 0) {
-                // Castle to the king's pawn
-                swap_squares(
-                    board_index((Position){ .file = 'h', .rank = kings_rank[piece.color] }, &game->board),
-                    board_index((Position){ .file = 'f', .rank = kings_rank[piece.color] }, &game->board)
-                );
-            } else {
-                // Castle to the queen's pawn
-                swap_squares(
-                    board_index((Position){ .file = 'a', .rank = kings_rank[piece.color] }, &game->board),
-                    board_index((Position){ .file = 'd', .rank = kings_rank[piece.color] }, &game->board)
-                );
-            }
-        }
-    } else if (piece.kind == PIECE_ROOK) {
-        Position kings, queens;
-        kings.rank = kings_rank[piece.color];
-        kings.file = 'h';
-        queens.rank = kings_rank[piece.color];
-        queens.file = 'a';
-        if (!game->has_rook_moved[piece.color].kings && STRUCT_EQ(Position, &move.origin, &kings)) {
-            game->has_rook_moved[piece.color].kings = true;
-        }
-        if (!game->has_rook_moved[piece.color].queens && STRUCT_EQ(Position, &move.origin, &queens)) {
-            game->has_rook_moved[piece.color].queens = true;
-        }
-    } else if (piece.kind == PIECE_PAWN) {
-        int offset = move.destination.rank - move.origin.rank;
-        if (abs(offset) == 2) {
-            // Must be a double push
-            game->double_pushed.has = true;
-            game->double_pushed.en_passant = move.origin;
-            game->double_pushed.en_passant.rank += offset / 2; // +1 square in the direction of the offset
-        }
-    }
+    if (move_kind(move) == MOVE_CASTLE) {
+        // Move the rook to the other side of the king
+        int rook, rook_dest;
+        castle_rook(move, &rook, &rook_dest);
+        Piece rook_piece = board_piece_at(board, rook);
+        remove_piece(game, rook);
+        put_piece(game, rook_dest, rook_piece);
+    } else if (piece.kind == PIECE_PAWN && abs(destination - origin) == 16) {
+        // Double push, the en passant square is the one that was skipped
+        game->double_pushed.has = true;
+        game->double_pushed.en_passant = index_position((origin + destination) / 2);
+    }
+    update_castling_rights(game, origin);
+    update_castling_rights(game, destination);
+
+    game->hash ^= zobrist_castling[castling_rights(game)];
+    if (game->double_pushed.has)
+        game->hash ^= zobrist_en_passant[game->double_pushed.en_passant.file - 'a'];
+    game->hash ^= zobrist_black_to_move;
+    if (game->turn == COLOR_BLACK)
+        game->fullmove_counter++;
+    game->turn = opposite(game->turn);
+    attack_map_add(game, changed, sliders);
+
+    return hist;
+}
 
-    game->fullmove_counter++;
+MoveHistory make_null_move(Game* game) {
+    MoveHistory hist;
+    hist.move = NULL_MOVE;
+    hist.double_pushed = game->double_pushed;
+    hist.halfmove_clock = game->halfmove_clock;
+    hist.fullmove_counter = game->fullmove_counter;
+    hist.hash = game->hash;
 
+    if (game->double_pushed.has)
+        game->hash ^= zobrist_en_passant[game->double_pushed.en_passant.file - 'a'];
+    game->double_pushed.has = false;
+    // No position before the pass may repeat after it
+    game->halfmove_clock = 0;
+    game->hash ^= zobrist_black_to_move;
+    if (game->turn == COLOR_BLACK)
+        game->fullmove_counter++;
+    game->turn = opposite(game->turn);
     return hist;
 }
 
-void unmake_move(Game* game, MoveHistory hist) {
-    Square* square;
+void unmake_null_move(Game* game, MoveHistory hist) {
+    game->double_pushed = hist.double_pushed;
+    game->halfmove_clock = hist.halfmove_clock;
+    game->fullmove_counter = hist.fullmove_counter;
+    game->hash = hist.hash;
+    game->turn = opposite(game->turn);
+}
 
-    square = board_index(hist.move.destination, &game->board);
-    Piece piece = square->piece;
-    if (hist.is_capture) {
-        square->piece = hist.captured;
-    } else {
-        square->has_piece = false;
-    }
-    square = board_index(hist.move.origin, &game->board);
-    square->has_piece = true;
-    square->piece = piece;
+void unmake_move(Game* game, MoveHistory hist) {
+    Board* board = &game->board;
+    Move move = hist.move;
+    int origin = move_origin(move);
+    int destination = move_destination(move);
+
+    Bitboard changed = move_squares(move);
+    Bitboard sliders = attack_map_remove(game, changed);
+    Piece piece = board_piece_at(board, destination);
+    unplace_piece(game, destination);
+    if (move_kind(move) == MOVE_PROMOTION) {
+        piece.kind = PIECE_PAWN;
+    }
+    restore_piece(game, origin, piece);
+
+    if (square_has_piece(hist.captured)) {
+        restore_piece(game, destination, square_piece(hist.captured));
+    } else if (move_kind(move) == MOVE_EN_PASSANT) {
+        Piece pawn = { .kind = PIECE_PAWN, .color = opposite(piece.color) };
+        restore_piece(game, en_passant_victim(move), pawn);
+    } else if (move_kind(move) == MOVE_CASTLE) {
+        // The rook goes back to its corner
+        int rook, rook_dest;
+        castle_rook(move, &rook, &rook_dest);
+        Piece rook_piece = board_piece_at(board, rook_dest);
+        unplace_piece(game, rook_dest);
+        restore_piece(game, rook, rook_piece);
+    }
+
+    memcpy(game->has_king_moved, hist.has_king_moved, sizeof(game->has_king_moved));
+    memcpy(game->has_rook_moved, hist.has_rook_moved, sizeof(game->has_rook_moved));
+    game->double_pushed = hist.double_pushed;
     game->halfmove_clock = hist.halfmove_clock;
-    game->fullmove_counter--;
-}
-
-int pawn_moves(Position pawn, PieceColor color, Game* game, Move moves[]) {
-    Square* square;
-    Move* move = moves;
-    Position dest = pawn;
-    bool can_take_en_passant;
-
-    switch (color) {
-        // White pawns can only go down
-        case COLOR_WHITE:
-            dest.rank++;
-            square = board_index(dest, &game->board);
-            if (square && !square->has_piece) {
-                move->origin = pawn;
-                move->destination = dest;
-                move++;
-            }
-            dest.file++;
-            square = board_index(dest, &game->board);
-            can_take_en_passant = game->double_pushed.has && STRUCT_EQ(Position, &game->double_pushed.en_passant, &dest);
-            if ((square && square->has_piece && square->piece.color != color) || can_take_en_passant) {
-                move->origin = pawn;
-                move->destination = dest;
-                move++;
-            }
-            dest.file -= 2;
-            square = board_index(dest, &game->board);
-            can_take_en_passant = game->double_pushed.has && STRUCT_EQ(Position, &game->double_pushed.en_passant, &dest);
-            if ((square && square->has_piece && square->piece.color != color) || can_take_en_passant) {
-                move->origin = pawn;
-                move->destination = dest;
-                move++;
-            }
+    game->fullmove_counter = hist.fullmove_counter;
+    game->hash = hist.hash;
+    game->eval = hist.eval;
+    game->turn = opposite(game->turn);
+    attack_map_add(game, changed, sliders);
+}
 
-            if (pawn.rank == '2') {
-                // Double push
-                dest = pawn;
-                dest.rank += 2;
-                if (!board_index(dest, &game->board)->has_piece) {
-                    move->origin = pawn;
-                    move->destination = dest;
-                    move++;
-                }
-            }
-            break;
+// Appends one move of `kind` from `origin` to each square in `targets`
+static Move* push_moves(int origin, Bitboard targets, int kind, Move* move) {
+    while (targets)
+        *move++ = mk_move(origin, bb_pop_lsb(&targets), kind);
+    return move;
+}
 
-        // Black pawns can only go up
-        case COLOR_BLACK:
-            dest.rank--;
-            square = board_index(dest, &game->board);
-            if (square && !square->has_piece) {
-                move->origin = pawn;
-                move->destination = dest;
-                move++;
-            }
-            dest.file++;
-            square = board_index(dest, &game->board);
-            can_take_en_passant = game->double_pushed.has && STRUCT_EQ(Position, &game->double_pushed.en_passant, &dest);
-            if ((square && square->has_piece && square->piece.color != color) || can_take_en_passant) {
-                move->origin = pawn;
-                move->destination = dest;
-                move++;
-            }
-            dest.file -= 2;
-            square = board_index(dest, &game->board);
-            can_take_en_passant = game->double_pushed.has && STRUCT_EQ(Position, &game->double_pushed.en_passant, &dest);
-            if ((square && square->has_piece && square->piece.color != color) || can_take_en_passant) {
-                move->origin = pawn;
-                move->destination = dest;
-                move++;
-            }
+// Like `push_moves`, but each move to the last rank becomes one move per
+// promotion.
+static Move* push_pawn_moves(int origin, Bitboard targets, Move* move) {
+    Bitboard promotions = targets & (BB_RANK_1 | BB_RANK_8);
+    move = push_moves(origin, targets & ~promotions, MOVE_NORMAL, move);
+    while (promotions) {
+        int destination = bb_pop_lsb(&promotions);
+        // We skip the pawn piece, since we can't promote to it.
+        for (const char* promotion = piece_kinds + 1; *promotion != 'k'; promotion++)
+            *move++ = mk_promotion(origin, destination, *promotion);
+    }
+    return move;
+}
 
-            if (pawn.rank == '7') {
-                // Double push
-                dest = pawn;
-                dest.rank -= 2;
-                if (!board_index(dest, &game->board)->has_piece) {
-                    move->origin = pawn;
-                    move->destination = dest;
-                    move++;
-                }
-            }
-            break;
-    }
+bool is_square_attacked(Game* game, Position position, PieceColor color) {
+    return is_attacked_by(game, position_index(position), color);
+}
 
-    Move* end_without_promotions = move;
-    // Add promotions
-    for (Move* m = moves; m < end_without_promotions; m++) {
-        if (m->destination.rank == kings_rank[opposite(color)]) {
-            // We skip the pawn piece, since we can't promote to it.
-            m->promotion = PIECE_KING;
-            for (const char* promotion = piece_kinds + 2; *promotion != 'k'; promotion++) {
-                move->origin = pawn;
-                move->destination = m->destination;
-                move->promotion = *promotion;
-                move++;
-            }
-        }
+static void compute_legality(Game* game, PieceColor color, Legality* legal) {
+    Board* board = &game->board;
+    PieceColor enemy = opposite(color);
+    assert(board_pieces(board, color, PIECE_KING) & BB(board->kings[color]));
+
+    legal->color = color;
+    legal->king = board->kings[color];
+    legal->occupied = board_occupied(board);
+    legal->checkers = 0;
+    if (is_attacked_by(game, legal->king, enemy))
+        legal->checkers = attackers_to(board, legal->king, legal->occupied) & board->colors[enemy];
+
+    legal->check_mask = ~(Bitboard)0;
+    if (legal->checkers) {
+        int checker = bb_lsb(legal->checkers);
+        legal->check_mask = legal->checkers | between_squares[legal->king][checker];
+    }
+
+    // A piece is pinned when it's the only one between the king and an enemy
+    // slider.
+    legal->pinned = 0;
+    Bitboard snipers = (bishop_rays[legal->king] & (board_pieces(board, enemy, PIECE_BISHOP) | board_pieces(board, enemy, PIECE_QUEEN)))
+                     | (rook_rays[legal->king] & (board_pieces(board, enemy, PIECE_ROOK) | board_pieces(board, enemy, PIECE_QUEEN)));
+    while (snipers) {
+        Bitboard blockers = between_squares[legal->king][bb_pop_lsb(&snipers)] & legal->occupied;
+        if (bb_count(blockers) == 1)
+            legal->pinned |= blockers & board->colors[color];
     }
-
-    return move - moves;
 }
 
-int knight_moves(Position knight, PieceColor color, Board* board, Move moves[]) {
-    Position dest;
-    Square* square;
-    Move* move = moves;
+// The generators below are specialized per side to move: inlined with a
+// constant `color`, the color checks are folded away.
 
-    // Down
-    dest = knight;
-    dest.rank += 2;
-    dest.file++;
-    square = board_index(dest, board);
-    if (square && (!square->has_piece || square->piece.color != color)) {
-        move->origin = knight;
-        move->destination = dest;
-        move++;
-    }
-    dest.file -= 2;
-    square = board_index(dest, board);
-    if (square && (!square->has_piece || square->piece.color != color)) {
-        move->origin = knight;
-        move->destination = dest;
-        move++;
-    }
+// Squares a piece may move to when generating `gen`, other than pawns
+static ALWAYS_INLINE Bitboard gen_targets(Game* game, const Legality* legal, MoveGen gen, const PieceColor color) {
+    Bitboard targets = 0;
+    if (gen & GEN_CAPTURES) targets |= game->board.colors[opposite(color)];
+    if (gen & GEN_QUIETS) targets |= ~legal->occupied;
+    return targets;
+}
 
-    // Up
-    dest = knight;
-    dest.rank -= 2;
-    dest.file++;
-    square = board_index(dest, board);
-    if (square && (!square->has_piece || square->piece.color != color)) {
-        move->origin = knight;
-        move->destination = dest;
-        move++;
-    }
-    dest.file -= 2;
-    square = board_index(dest, board);
-    if (square && (!square->has_piece || square->piece.color != color)) {
-        move->origin = knight;
-        move->destination = dest;
-        move++;
+static ALWAYS_INLINE Move* king_moves(Game* game, const Legality* legal, MoveGen gen, Move* move, const PieceColor color) {
+    Board* board = &game->board;
+    PieceColor enemy = opposite(color);
+    int king = legal->king;
+    Bitboard attacked = game->attacks.by_color[enemy];
+    // The attack map stops sliders at the king, but sliders giving check keep
+    // attacking the squares behind it, so the king can't step back along the
+    // line of a check.
+    Bitboard danger = attacked;
+    Bitboard sliders = legal->checkers & ~board->kinds[piece_kind_index(PIECE_PAWN)]
+                                       & ~board->kinds[piece_kind_index(PIECE_KNIGHT)];
+    while (sliders) {
+        int checker = bb_pop_lsb(&sliders);
+        danger |= line_squares[checker][king] & ~BB(checker);
+    }
+    move = push_moves(king, king_attacks[king] & gen_targets(game, legal, gen, color) & ~danger, MOVE_NORMAL, move);
+
+    if ((gen & GEN_QUIETS) && !game->has_king_moved[color] && !legal->checkers) {
+        Bitboard rooks = board_pieces(board, color, PIECE_ROOK);
+        // a1 or a8, the king and rooks are at a fixed offset from it
+        int base = position_index((Position){ .file = 'a', .rank = kings_rank[color] });
+
+        // The king may not castle through or into check
+        if (!game->has_rook_moved[color].kings && (rooks & BB(base + 7))
+                && !(legal->occupied & (BB(base + 5) | BB(base + 6)))
+                && !(attacked & (BB(base + 5) | BB(base + 6)))) {
+            *move++ = mk_move(king, base + 6, MOVE_CASTLE);
+        }
+        if (!game->has_rook_moved[color].queens && (rooks & BB(base))
+                && !(legal->occupied & (BB(base + 1) | BB(base + 2) | BB(base + 3)))
+                && !(attacked & (BB(base + 2) | BB(base + 3)))) {
+            *move++ = mk_move(king, base + 2, MOVE_CASTLE);
+        }
     }
+    return move;
+}
 
-    // Right
-    dest = knight;
-    dest.file += 2;
-    dest.rank++;
-    square = board_index(dest, board);
-    if (square && (!square->has_piece || square->piece.color != color)) {
-        move->origin = knight;
-        move->destination = dest;
-        move++;
-    }
-    dest.rank -= 2;
-    square = board_index(dest, board);
-    if (square && (!square->has_piece || square->piece.color != color)) {
-        move->origin = knight;
-        move->destination = dest;
-        move++;
-    }
+// Squares one rank ahead of `squares` from the point of view of `color`
+static ALWAYS_INLINE Bitboard pawn_push(Bitboard squares, const PieceColor color) {
+    return color == COLOR_WHITE ? squares << 8 : squares >> 8;
+}
 
-    // Left
-    dest = knight;
-    dest.file -= 2;
-    dest.rank++;
-    square = board_index(dest, board);
-    if (square && (!square->has_piece || square->piece.color != color)) {
-        move->origin = knight;
-        move->destination = dest;
-        move++;
-    }
-    dest.rank -= 2;
-    square = board_index(dest, board);
-    if (square && (!square->has_piece || square->piece.color != color)) {
-        move->origin = knight;
-        move->destination = dest;
-        move++;
+static ALWAYS_INLINE Move* pawn_moves(Game* game, const Legality* legal, int index, Bitboard allowed, MoveGen gen, Move* move, const PieceColor color) {
+    Board* board = &game->board;
+    Bitboard empty = ~legal->occupied;
+    // The rank a pawn lands on after a double push
+    Bitboard double_rank = color == COLOR_WHITE ? BB_RANK_1 << 24 : BB_RANK_1 << 32;
+    Bitboard single = pawn_push(BB(index), color) & empty;
+    Bitboard pushes = single | (pawn_push(single, color) & empty & double_rank);
+    Bitboard targets = 0;
+    if (gen & GEN_PROMOTIONS) targets |= pushes & (BB_RANK_1 | BB_RANK_8);
+    if (gen & GEN_QUIETS) targets |= pushes & ~(BB_RANK_1 | BB_RANK_8);
+    if (gen & GEN_CAPTURES) targets |= pawn_attacks[color][index] & board->colors[opposite(color)];
+    move = push_pawn_moves(index, targets & allowed, move);
+    if (!(gen & GEN_CAPTURES)) return move;
+
+    // Only the side that did not double push may take en passant
+    if (game->double_pushed.has && game->double_pushed.en_passant.rank == (color == COLOR_WHITE ? '6' : '3')) {
+        int ep = position_index(game->double_pushed.en_passant);
+        int captured = color == COLOR_WHITE ? ep - 8 : ep + 8;
+        if (pawn_attacks[color][index] & BB(ep)) {
+            // Two pieces leave the pawns' rank at once, which may uncover
+            // the king, so just check if it would be attacked.
+            Bitboard occupied = (legal->occupied ^ BB(index) ^ BB(captured)) | BB(ep);
+            Bitboard attackers = attackers_to(board, legal->king, occupied)
+                               & board->colors[opposite(color)] & ~BB(captured);
+            if (!attackers)
+                *move++ = mk_move(index, ep, MOVE_EN_PASSANT);
+        }
     }
-
-    return move - moves;
+    return move;
 }
 
-int bishop_moves(Position bishop, PieceColor color, Board* board, Move moves[]) {
-    Position dest;
-    Square* square;
-    Move* move = moves;
-
-    // Down-Right
-    for (dest = bishop; ++dest.rank <= '8' && ++dest.file <= 'h' && !board_index(dest, board)->has_piece; move++) {
-        move->origin = bishop;
-        move->destination = dest;
-    }
-    square = board_index(dest, board);
-    if (square && square->piece.color != color) {
-        move->origin = bishop;
-        move->destination = dest;
-        move++;
-    }
+// Legal moves of the piece at `index` of the kinds in `gen`. The piece must be
+// of the color `legal` was computed for.
+static ALWAYS_INLINE Move* legal_piece_moves(Game* game, const Legality* legal, int index, Piece piece, MoveGen gen, Move* move, const PieceColor color) {
+    if (piece.kind == PIECE_KING)
+        return king_moves(game, legal, gen, move, color);
+    // In double check only the king may move
+    if (bb_count(legal->checkers) > 1)
+        return move;
+
+    Bitboard allowed = legal->check_mask & ~game->board.colors[color];
+    if (legal->pinned & BB(index))
+        allowed &= line_squares[legal->king][index];
+    if (piece.kind == PIECE_PAWN)
+        return pawn_moves(game, legal, index, allowed, gen, move, color);
+
+    allowed &= gen_targets(game, legal, gen, color);
+    return push_moves(index, piece_attacks_from(piece, index, legal->occupied) & allowed, MOVE_NORMAL, move);
+}
 
-    // Down-Left
-    for (dest = bishop; ++dest.rank <= '8' && --dest.file >= 'a' && !board_index(dest, board)->has_piece; move++) {
-        move->origin = bishop;
-        move->destination = dest;
-    }
-    square = board_index(dest, board);
-    if (square && square->piece.color != color) {
-        move->origin = bishop;
-        move->destination = dest;
-        move++;
-    }
+// Dispatches to the specialization of `legal_piece_moves` for the color of
+// `legal`
+static Move* piece_moves(Game* game, const Legality* legal, int index, Piece piece, MoveGen gen, Move* move) {
+    if (legal->color == COLOR_WHITE)
+        return legal_piece_moves(game, legal, index, piece, gen, move, COLOR_WHITE);
+    return legal_piece_moves(game, legal, index, piece, gen, move, COLOR_BLACK);
+}
 
-    // Up-Right
-    for (dest = bishop; --dest.rank >= '1' && ++dest.file <= 'h' && !board_index(dest, board)->has_piece; move++) {
-        move->origin = bishop;
-        move->destination = dest;
-    }
-    square = board_index(dest, board);
-    if (square && square->piece.color != color) {
-        move->origin = bishop;
-        move->destination = dest;
-        move++;
+static ALWAYS_INLINE int generate_color(Game* game, const Legality* legal, MoveGen gen, MoveList* list, const PieceColor color) {
+    Move* moves_top = king_moves(game, legal, gen, list->moves, color);
+    if (bb_count(legal->checkers) <= 1) {
+        Bitboard pieces = game->board.colors[color] & ~BB(legal->king);
+        while (pieces) {
+            int index = bb_pop_lsb(&pieces);
+            Piece piece = board_piece_at(&game->board, index);
+            moves_top = legal_piece_moves(game, legal, index, piece, gen, moves_top, color);
+        }
     }
+    list->count = moves_top - list->moves;
+    return list->count;
+}
 
-    // Up-Left
-    for (dest = bishop; --dest.rank >= '1' && --dest.file >= 'a' && !board_index(dest, board)->has_piece; move++) {
-        move->origin = bishop;
-        move->destination = dest;
-    }
-    square = board_index(dest, board);
-    if (square && square->piece.color != color) {
-        move->origin = bishop;
-        move->destination = dest;
-        move++;
-    }
+static inline int generate_with(Game* game, const Legality* legal, MoveGen gen, MoveList* list) {
+    if (legal->color == COLOR_WHITE)
+        return generate_color(game, legal, gen, list, COLOR_WHITE);
+    return generate_color(game, legal, gen, list, COLOR_BLACK);
+}
 
-    return move - moves;
+int valid_piece_moves(Position position, Piece piece, Game* game, MoveList* list) {
+    Legality legal;
+    compute_legality(game, piece.color, &legal);
+    Move* end = piece_moves(game, &legal, position_index(position), piece, GEN_ALL, list->moves);
+    list->count = end - list->moves;
+    return list->count;
 }
 
-int rook_moves(Position rook, PieceColor color, Board* board, Move moves[]) {
-    Position dest;
-    Square* square;
-    Move* move = moves;
+int generate_moves(Game* game, MoveGen gen, MoveList* list) {
+    Legality legal;
+    compute_legality(game, game->turn, &legal);
+    return generate_with(game, &legal, gen, list);
+}
 
-    // Down
-    for (dest = rook; ++dest.rank <= '8' && !board_index(dest, board)->has_piece; move++) {
-        move->origin = rook;
-        move->destination = dest;
-    }
-    square = board_index(dest, board);
-    if (square && square->piece.color != color) {
-        move->origin = rook;
-        move->destination = dest;
-        move++;
-    }
+int all_valid_moves(Game* game, MoveList* list) {
+    Legality legal;
+    compute_legality(game, game->turn, &legal);
+    return generate_with(game, &legal, GEN_ALL, list);
+}
 
-    // Up
-    for (dest = rook; --dest.rank >= '1' && !board_index(dest, board)->has_piece; move++) {
-        move->origin = rook;
-        move->destination = dest;
-    }
-    square = board_index(dest, board);
-    if (square && square->piece.color != color) {
-        move->origin = rook;
-        move->destination = dest;
-        move++;
+static ALWAYS_INLINE bool any_legal_move_color(Game* game, const Legality* legal, const PieceColor color) {
+    Move moves[MAX_MOVES];
+    if (king_moves(game, legal, GEN_ALL, moves, color) != moves)
+        return true;
+    // In double check only the king may move
+    if (bb_count(legal->checkers) > 1)
+        return false;
+
+    Bitboard own = game->board.colors[color];
+    Bitboard pieces = own & ~BB(legal->king);
+    while (pieces) {
+        int index = bb_pop_lsb(&pieces);
+        Piece piece = board_piece_at(&game->board, index);
+        if (piece.kind == PIECE_PAWN) {
+            if (legal_piece_moves(game, legal, index, piece, GEN_ALL, moves, color) != moves)
+                return true;
+            continue;
+        }
+        // Other pieces may go to any square they attack that is allowed, so
+        // there's no need to list their moves.
+        Bitboard allowed = legal->check_mask & ~own;
+        if (legal->pinned & BB(index))
+            allowed &= line_squares[legal->king][index];
+        if (piece_attacks_from(piece, index, legal->occupied) & allowed)
+            return true;
     }
+    return false;
+}
 
-    // Right
-    for (dest = rook; ++dest.file <= 'h' && !board_index(dest, board)->has_piece; move++) {
-        move->origin = rook;
-        move->destination = dest;
-    }
-    square = board_index(dest, board);
-    if (square && square->piece.color != color) {
-        move->origin = rook;
-        move->destination = dest;
-        move++;
-    }
+bool has_any_legal_move(Game* game) {
+    Legality legal;
+    compute_legality(game, game->turn, &legal);
+    if (legal.color == COLOR_WHITE)
+        return any_legal_move_color(game, &legal, COLOR_WHITE);
+    return any_legal_move_color(game, &legal, COLOR_BLACK);
+}
 
-    // Left
-    for (dest = rook; --dest.file >= 'a' && !board_index(dest, board)->has_piece; move++) {
-        move->origin = rook;
-        move->destination = dest;
-    }
-    square = board_index(dest, board);
-    if (square && square->piece.color != color) {
-        move->origin = rook;
-        move->destination = dest;
-        move++;
-    }
+bool is_in_check(Game* game) {
+    return is_attacked_by(game, game->board.kings[game->turn], opposite(game->turn));
+}
 
-    return move - moves;
-}
-
-int queen_moves(Position queen, PieceColor color, Board* board, Move moves[]) {
-    Move* move = moves;
-    move += bishop_moves(queen, color, board, move);
-    move += rook_moves(queen, color, board, move);
-    return move - moves;
-}
-
-int king_moves(Position king, PieceColor color, Game* game, Move moves[]) {
-    Move* move = moves;
-    for (int dr = -1; dr <= 1; dr++) {
-        for (int dc = -1; dc <= 1; dc++) {
-            if (dr == 0 && dc == 0) continue;
-            Position dest = king;
-            dest.rank += dr;
-            dest.file += dc;
-            Square* square = board_index(dest, &game->board);
-            if (square && (!square->has_piece || square->piece.color != color)) {
-                move->origin = king;
-                move->destination = dest;
-                move++;
-            }
-        }
-    }
-    if (!game->has_king_moved[color]) {
-        if (!game->has_rook_moved[color].kings) {
-            bool is_path_clear = false;
-            Position pos;
-            pos.rank = kings_rank[color];
-            for (pos.file = 'f'; pos.file < 'h'; pos.file++) {
-                if (board_index(pos, &game->board)->has_piece) {
-                    is_path_clear = false;
-                    break;
-                }
-            }
-            if (is_path_clear) {
-                pos.file = 'g';
-                move->origin = king;
-                move->destination = pos;
-                move++;
-            }
-        }
-        if (!game->has_rook_moved[color].queens) {
-            bool is_path_clear = false;
-            Position pos;
-            pos.rank = kings_rank[color];
-            for (pos.file = 'b'; pos.file < 'e'; pos.file++) {
-                if (board_index(pos, &game->board)->has_piece) {
-                    is_path_clear = false;
-                    break;
-                }
-            }
-            if (is_path_clear) {
-                pos.file = 'c';
-                move->origin = king;
-                move->destination = pos;
-                move++;
-            }
-        }
-    }
-    return move - moves;
-}
-
-int piece_moves(Position position, Piece piece, Game* game, Move moves[]) {
-    switch (piece.kind) {
-        case PIECE_PAWN:
-            return pawn_moves(position, piece.color, game, moves);
-        case PIECE_KNIGHT:
-            return knight_moves(position, piece.color, &game->board, moves);
-        case PIECE_BISHOP:
-            return bishop_moves(position, piece.color, &game->board, moves);
-        case PIECE_ROOK:
-            return rook_moves(position, piece.color, &game->board, moves);
-        case PIECE_QUEEN:
-            return queen_moves(position, piece.color, &game->board, moves);
-        case PIECE_KING:
-            return king_moves(position, piece.color, game, moves);
-    }
+GameStatus game_status(Game* game) {
+    if (has_any_legal_move(game))
+        return GAME_ONGOING;
+    return is_in_check(game) ? GAME_CHECKMATE : GAME_STALEMATE;
 }
 
-bool is_position_attacked_by_moves(Position pos, Move moves[], int nmoves) {
-    for (int i = 0; i < nmoves; i++) {
-        if (STRUCT_EQ(Position, &moves[i].destination, &pos)) {
+bool check_move(Move* move, MoveList* valid_moves) {
+    for (int i = 0; i < valid_moves->count; i++) {
+        Move valid = valid_moves->moves[i];
+        // Castles and en passant captures look like normal moves in UCI
+        if (move_kind(valid) == MOVE_CASTLE || move_kind(valid) == MOVE_EN_PASSANT)
+            valid = mk_move(move_origin(valid), move_destination(valid), MOVE_NORMAL);
+        if (valid == *move) {
+            *move = valid_moves->moves[i];
             return true;
         }
     }
     return false;
 }
 
-int remove_invalid_moves(Piece piece, Game* game, Move moves[], int nmoves) {
-    Position enemy_pieces[16];
-    Position* enemy_piece_top = enemy_pieces;
-
-    Position ally_king = INVALID_POSITION;
-    Position pos;
-    for (pos.rank = '1'; pos.rank <= '8'; pos.rank++) {
-        for (pos.file = 'a'; pos.file <= 'h'; pos.file++) {
-            Square* square = board_index(pos, &game->board);
-            if (square->has_piece) {
-                if (square->piece.color != piece.color) {
-                    *(enemy_piece_top++) = pos;
-                } else if (square->piece.kind == PIECE_KING) {
-                    ally_king = pos;
-                }
-            }
-        }
-    }
+bool is_move_valid(Move* move, Game* game) {
+    Square* square = board_index(index_position(move_origin(*move)), &game->board);
+    if (!square_has_piece(*square) || square_color(*square) != game->turn) return false;
 
-    assert(!STRUCT_EQ(Position, &ally_king, &INVALID_POSITION));
-
-    for (int i = nmoves-1; i >= 0; i--) {
-        Move move = moves[i];
-        Game clone;
-        memcpy(&clone, game, sizeof(Game));
-        make_move(&clone, move);
-
-        Move enemy_moves[MAX_MOVES];
-        memset(enemy_moves, 0, sizeof(enemy_moves));
-        Move* enemy_moves_top = enemy_moves;
-        for (Position* enemy_piece = enemy_pieces; enemy_piece < enemy_piece_top; enemy_piece++) {
-            // If the current move takes an enemy piece, we simply skip that enemy.
-            if (STRUCT_EQ(Position, enemy_piece, &move.destination)) continue;
-            Piece piece = board_index(*enemy_piece, &clone.board)->piece;
-            enemy_moves_top += piece_moves(*enemy_piece, piece, &clone, enemy_moves_top);
-        }
-        int n_enemy_moves = enemy_moves_top - enemy_moves;
-        if (is_position_attacked_by_moves(ally_king, enemy_moves, n_enemy_moves)) {
-            // King in check after move, the move is invalid
-            moves[i] = moves[--nmoves]; // swap remove
-        }
+    MoveList moves;
+    valid_piece_moves(index_position(move_origin(*move)), square_piece(*square), game, &moves);
+    return check_move(move, &moves);
+}
+
+MoveGen move_gen_kind(Game* game, Move move) {
+    int destination = move_destination(move);
+    if (square_has_piece(game->board.squares[destination / 8][destination % 8]) || move_kind(move) == MOVE_EN_PASSANT)
+        return GEN_CAPTURES;
+    if (move_kind(move) == MOVE_PROMOTION)
+        return GEN_PROMOTIONS;
+    return GEN_QUIETS;
+}
+
+// The hash move and killers may come from other positions, so they have to
+// be checked before they're played. Whether `move` is a legal move of the
+// kinds in `gen` here.
+static bool is_legal_here(MovePicker* picker, Move move, MoveGen gen) {
+    Game* game = picker->game;
+    if (move == NULL_MOVE) return false;
+
+    int origin = move_origin(move);
+    Square square = game->board.squares[origin / 8][origin % 8];
+    if (!square_has_piece(square) || square_color(square) != game->turn) return false;
+    if (!(move_gen_kind(game, move) & gen)) return false;
+
+    Move moves[MAX_MOVES];
+    Move* end = piece_moves(game, &picker->legal, origin, square_piece(square), gen, moves);
+    for (Move* m = moves; m < end; m++)
+        if (*m == move) return true;
+    return false;
+}
+
+void move_picker_init(MovePicker* picker, Game* game, Move hash_move, MoveGen gen, const MoveOrder* order) {
+    picker->game = game;
+    picker->gen = gen;
+    picker->order = order;
+    picker->stage = PICK_HASH_MOVE;
+    picker->next = 0;
+    picker->moves.count = 0;
+    picker->bad_captures.count = 0;
+    for (int i = 0; i < MAX_KILLERS; i++)
+        picker->killers[i] = NULL_MOVE;
+    compute_legality(game, game->turn, &picker->legal);
+
+    picker->hash_move = NULL_MOVE;
+    if (is_legal_here(picker, hash_move, gen)) {
+        picker->hash_move = hash_move;
+        picker->moves.moves[picker->moves.count++] = hash_move;
     }
-    return nmoves;
 }
 
-int valid_piece_moves(Position position, Piece piece, Game* game, Move moves[]) {
-    int count = piece_moves(position, piece, game, moves);
-    return remove_invalid_moves(piece, game, moves, count);
+// Most valuable victim, then least valuable attacker
+static int capture_score(const Game* game, Move move) {
+    int origin = move_origin(move);
+    int destination = move_destination(move);
+    Square victim = game->board.squares[destination / 8][destination % 8];
+    // Only en passant captures on an empty square
+    int victim_value = piece_values[square_has_piece(victim) ? square_kind_index(victim) : piece_kind_index(PIECE_PAWN)];
+    return victim_value * NUM_PIECE_KINDS - square_kind_index(game->board.squares[origin / 8][origin % 8]);
 }
 
-int all_valid_moves(Game* game, Move moves[]) {
-    Move* moves_top = moves;
-    Position pos;
-    for (pos.rank = '1'; pos.rank <= '8'; pos.rank++) {
-        for (pos.file = 'a'; pos.file <= 'h'; pos.file++) {
-            Square* square = board_index(pos, &game->board);
-            if (square->has_piece && square->piece.color == game->turn)
-                moves_top += valid_piece_moves(pos, square->piece, game, moves_top);
-        }
+// Whether the capture `move` loses material once the exchange on its
+// destination plays out. Taking a piece worth at least the attacker never
+// does, so `see` only runs for the others.
+static bool is_bad_capture(const Game* game, Move move) {
+    int origin = move_origin(move);
+    int destination = move_destination(move);
+    Square victim = game->board.squares[destination / 8][destination % 8];
+    if (!square_has_piece(victim)) return false;
+    int attacker_value = piece_values[square_kind_index(game->board.squares[origin / 8][origin % 8])];
+    return attacker_value > piece_values[square_kind_index(victim)] && see(game, move) < 0;
+}
+
+// Whether the moves of the current stage are tried best score first
+static bool is_stage_sorted(const MovePicker* picker) {
+    const MoveOrder* order = picker->order;
+    if (!order) return false;
+    return (picker->stage == PICK_CAPTURES && order->sort_captures)
+        || (picker->stage == PICK_QUIETS && order->history);
+}
+
+static void score_moves(MovePicker* picker) {
+    for (int i = 0; i < picker->moves.count; i++) {
+        Move move = picker->moves.moves[i];
+        if (picker->stage == PICK_CAPTURES)
+            picker->scores[i] = capture_score(picker->game, move);
+        else
+            picker->scores[i] = picker->order->history[move_origin(move)][move_destination(move)];
     }
-    return moves_top - moves;
 }
 
-bool check_move(Move move, Game* game, Move valid_moves[], int nmoves) {
-    for (int i = 0; i < nmoves; i++) {
-        if (STRUCT_EQ(Move, valid_moves + i, &move))
-            return true;
+// Yields the best scored move left. A selection sort, as a cutoff usually
+// comes before many moves are tried.
+static Move pick_best(MovePicker* picker) {
+    int next = picker->next;
+    int best = next;
+    for (int i = next + 1; i < picker->moves.count; i++)
+        if (picker->scores[i] > picker->scores[best])
+            best = i;
+    Move move = picker->moves.moves[best];
+    picker->moves.moves[best] = picker->moves.moves[next];
+    picker->scores[best] = picker->scores[next];
+    picker->moves.moves[next] = move;
+    picker->next++;
+    return move;
+}
+
+// Moves on to the next stage, generating its moves if they were asked for
+static void next_stage(MovePicker* picker) {
+    static const MoveGen stage_gen[PICK_DONE + 1] = {
+        [PICK_CAPTURES]   = GEN_CAPTURES,
+        [PICK_PROMOTIONS] = GEN_PROMOTIONS,
+        [PICK_QUIETS]     = GEN_QUIETS,
+    };
+
+    picker->stage++;
+    picker->next = 0;
+    picker->moves.count = 0;
+    switch (picker->stage) {
+        case PICK_KILLERS:
+            if (!picker->order || !(picker->gen & GEN_QUIETS)) break;
+            for (int i = 0; i < MAX_KILLERS; i++) {
+                Move killer = picker->order->killers[i];
+                if (killer != picker->hash_move && is_legal_here(picker, killer, GEN_QUIETS)) {
+                    picker->killers[i] = killer;
+                    picker->moves.moves[picker->moves.count++] = killer;
+                }
+            }
+            break;
+
+        case PICK_BAD_CAPTURES:
+            memcpy(picker->moves.moves, picker->bad_captures.moves, picker->bad_captures.count * sizeof(Move));
+            picker->moves.count = picker->bad_captures.count;
+            break;
+
+        default:
+            if (!(picker->gen & stage_gen[picker->stage])) break;
+            generate_with(picker->game, &picker->legal, stage_gen[picker->stage], &picker->moves);
+            if (is_stage_sorted(picker))
+                score_moves(picker);
+            break;
     }
-    return false;
 }
 
-bool is_move_valid(Move move, Game* game) {
-    Square* square = board_index(move.origin, &game->board);
-    if (!square || !square->has_piece || square->piece.color != game->turn) return false;
+// Whether `move` of the current stage was already yielded by an earlier one
+static bool was_yielded(const MovePicker* picker, Move move) {
+    if (picker->stage == PICK_HASH_MOVE || picker->stage == PICK_BAD_CAPTURES) return false;
+    if (move == picker->hash_move) return true;
+    if (picker->stage != PICK_QUIETS) return false;
+    for (int i = 0; i < MAX_KILLERS; i++)
+        if (move == picker->killers[i]) return true;
+    return false;
+}
 
-    Move moves[MAX_MOVES_PIECE];
-    memset(moves, 0, sizeof(moves));
-    int count = valid_piece_moves(move.origin, square->piece, game, moves);
-    return check_move(move, game, moves, count);
+Move move_picker_next(MovePicker* picker) {
+    while (picker->stage != PICK_DONE) {
+        bool sorted = is_stage_sorted(picker);
+        while (picker->next < picker->moves.count) {
+            Move move = sorted ? pick_best(picker) : picker->moves.moves[picker->next++];
+            if (was_yielded(picker, move)) continue;
+            if (picker->stage == PICK_CAPTURES && sorted && is_bad_capture(picker->game, move)) {
+                picker->bad_captures.moves[picker->bad_captures.count++] = move;
+                continue;
+            }
+            return move;
+        }
+        next_stage(picker);
+    }
+    return NULL_MOVE;
 }
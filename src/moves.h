@@ -2,16 +2,131 @@
 
 #include "common.h"
 
+// Kinds of moves to generate, may be combined
+typedef enum {
+    // Including promotions that capture and en passant
+    GEN_CAPTURES   = 1 << 0,
+    // Promotions that don't capture
+    GEN_PROMOTIONS = 1 << 1,
+    // Everything else, including castles
+    GEN_QUIETS     = 1 << 2,
+    GEN_ALL        = GEN_CAPTURES | GEN_PROMOTIONS | GEN_QUIETS,
+} MoveGen;
+
+// Everything needed to tell legal moves apart, computed once per position
+typedef struct {
+    PieceColor color;
+    int king;
+    Bitboard occupied;
+    // Enemy pieces giving check
+    Bitboard checkers;
+    // Pieces of `color` that may only move along the line to their king
+    Bitboard pinned;
+    // Squares a piece other than the king may move to: anywhere when not in
+    // check, otherwise the checker or a square between it and the king
+    Bitboard check_mask;
+} Legality;
+
+typedef enum {
+    GAME_ONGOING = 0,
+    // The side to move has no legal move and is in check
+    GAME_CHECKMATE,
+    // The side to move has no legal move but isn't in check
+    GAME_STALEMATE,
+} GameStatus;
+
+typedef enum {
+    PICK_HASH_MOVE = 0,
+    PICK_CAPTURES,
+    PICK_PROMOTIONS,
+    PICK_KILLERS,
+    PICK_QUIETS,
+    PICK_BAD_CAPTURES,
+    PICK_DONE,
+} PickStage;
+
+#define MAX_KILLERS 2
+
+// What the search learned about which moves are good, to try them first
+typedef struct {
+    // Captures are tried most valuable victim first, then least valuable
+    // attacker first, and those that lose material by `see` after the
+    // quiet moves
+    bool sort_captures;
+    // Quiet moves that caused a cutoff at the same ply in other positions,
+    // NULL_MOVE when unused. Tried before the other quiet moves.
+    Move killers[MAX_KILLERS];
+    // How much each quiet move of the side to move, by origin and
+    // destination, caused cutoffs. Quiet moves are tried highest first. May be
+    // NULL.
+    const int (*history)[64];
+} MoveOrder;
+
+// Yields the legal moves of a position one at a time, in stages: first the
+// hash move, then captures, promotions, killers, quiet moves and finally
+// captures that lose material. Each stage is only generated once the
+// previous one runs out, so callers that stop early don't pay for the rest.
+typedef struct {
+    Game* game;
+    Legality legal;
+    Move hash_move;
+    MoveGen gen;
+    const MoveOrder* order;
+    // Stage of the last move yielded
+    PickStage stage;
+    int next;
+    MoveList moves;
+    int scores[MAX_MOVES];
+    MoveList bad_captures;
+    // Killers found legal, so that they aren't yielded again with the quiets
+    Move killers[MAX_KILLERS];
+} MovePicker;
+
 MoveHistory make_move(Game* game, Move move);
 
 void unmake_move(Game* game, MoveHistory hist);
 
-int valid_piece_moves(Position position, Piece piece, Game* game, Move moves[]);
+// Passes the turn without moving, for null move pruning. The side to move
+// must not be in check. Only `unmake_null_move` may take it back.
+MoveHistory make_null_move(Game* game);
+
+void unmake_null_move(Game* game, MoveHistory hist);
+
+int valid_piece_moves(Position position, Piece piece, Game* game, MoveList* list);
+
+int all_valid_moves(Game* game, MoveList* list);
+
+// Legal moves of the side to move of the kinds in `gen`
+int generate_moves(Game* game, MoveGen gen, MoveList* list);
+
+// Which of GEN_CAPTURES, GEN_PROMOTIONS or GEN_QUIETS `move` belongs to
+MoveGen move_gen_kind(Game* game, Move move);
+
+// Stops at the first legal move found, much cheaper than generating them all
+bool has_any_legal_move(Game* game);
+
+// Whether the side to move is in check
+bool is_in_check(Game* game);
+
+GameStatus game_status(Game* game);
+
+// Whether any piece of `color` attacks `position`
+bool is_square_attacked(Game* game, Position position, PieceColor color);
 
-int all_valid_moves(Game* game, Move moves[]);
+// Looks `move` up in `valid_moves`. It may lack the castle or en passant kind,
+// as moves parsed from UCI do, so when found `move` is replaced by the valid
+// move, which is safe to pass to `make_move`.
+bool check_move(Move* move, MoveList* valid_moves);
 
-bool is_position_attacked_by_moves(Position pos, Move moves[], int nmoves);
+// Whether `move` is legal for the side to move. Only the moves of the piece
+// on its origin are generated. Like `check_move`, `move` is replaced by the
+// legal move when found.
+bool is_move_valid(Move* move, Game* game);
 
-bool check_move(Move move, Game* game, Move valid_moves[], int nmoves);
+// Only moves of the kinds in `gen` are yielded. `hash_move` is tried first if
+// it's legal, pass NULL_MOVE if there's none. With `order` NULL the moves of
+// each stage come in generation order, otherwise it must outlive the picker.
+void move_picker_init(MovePicker* picker, Game* game, Move hash_move, MoveGen gen, const MoveOrder* order);
 
-bool is_move_valid(Move move, Game* game);
+// The next move, or NULL_MOVE once every move was yielded
+Move move_picker_next(MovePicker* picker);
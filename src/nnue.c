@@ -0,0 +1,206 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "common.h"
+#include "bitboard.h"
+#include "nnue.h"
+
+Result nnue_load(Network* this, const char* path) {
+    int fd = open(path, O_RDONLY);
+    ASSERT_OR(fd >= 0, LIBC);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return ERROR(LIBC);
+    }
+    if (st.st_size != NNUE_FILE_SIZE) {
+        close(fd);
+        errno = EINVAL;
+        return ERROR(LIBC);
+    }
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    ASSERT_OR(mapping != MAP_FAILED, LIBC);
+
+    const NetworkHeader* header = mapping;
+    if (memcmp(header->magic, NNUE_MAGIC, 4) != 0 || header->version != NNUE_VERSION
+            || header->inputs != NNUE_INPUTS || header->hidden != NNUE_HIDDEN || header->l1 != NNUE_L1) {
+        munmap(mapping, st.st_size);
+        errno = EINVAL;
+        return ERROR(LIBC);
+    }
+
+    const char* p = (const char*)mapping + NNUE_HEADER_SIZE;
+    this->ft_bias = (const int16_t*)p;
+    p += NNUE_HIDDEN * sizeof(int16_t);
+    this->ft_weights = (const int16_t*)p;
+    p += NNUE_INPUTS * NNUE_HIDDEN * sizeof(int16_t);
+    this->l1_bias = (const int32_t*)p;
+    p += NNUE_L1 * sizeof(int32_t);
+    this->l1_weights = (const int8_t*)p;
+    p += NNUE_L1 * 2 * NNUE_HIDDEN;
+    this->l2_bias = (const int32_t*)p;
+    p += sizeof(int32_t);
+    this->l2_weights = (const int8_t*)p;
+
+    this->mapping = mapping;
+    this->size = st.st_size;
+#if defined(__x86_64__)
+    this->avx2 = __builtin_cpu_supports("avx2");
+#else
+    this->avx2 = false;
+#endif
+    return RESULT_OK;
+}
+
+void nnue_free(Network* net) {
+    munmap(net->mapping, net->size);
+}
+
+// Index of the feature of `piece` at `index` from the point of view of
+// `perspective`: its own pieces first, and black sees the board upside down
+static inline int feature(PieceColor perspective, Piece piece, int index) {
+    int side = piece.color == perspective ? 0 : 1;
+    int square = perspective == COLOR_WHITE ? index : index ^ 56;
+    return (side * NUM_PIECE_KINDS + piece_kind_index(piece.kind)) * 64 + square;
+}
+
+static void add_column_scalar(int16_t* acc, const int16_t* column, int sign) {
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+        acc[i] += sign * column[i];
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void add_column_avx2(int16_t* acc, const int16_t* column, int sign) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(acc + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(column + i));
+        a = sign > 0 ? _mm256_add_epi16(a, w) : _mm256_sub_epi16(a, w);
+        _mm256_storeu_si256((__m256i*)(acc + i), a);
+    }
+}
+#endif
+
+// Adds or subtracts the weights of a piece's feature in both accumulators
+static void update(Game* game, Piece piece, int index, int sign) {
+    const Network* net = game->nnue;
+    for (PieceColor perspective = COLOR_WHITE; perspective <= COLOR_BLACK; perspective++) {
+        const int16_t* column = &net->ft_weights[feature(perspective, piece, index) * NNUE_HIDDEN];
+#if defined(__x86_64__)
+        if (net->avx2) {
+            add_column_avx2(game->accumulator->values[perspective], column, sign);
+            continue;
+        }
+#endif
+        add_column_scalar(game->accumulator->values[perspective], column, sign);
+    }
+}
+
+void nnue_add_piece(Game* game, Piece piece, int index) {
+    update(game, piece, index, 1);
+}
+
+void nnue_remove_piece(Game* game, Piece piece, int index) {
+    update(game, piece, index, -1);
+}
+
+void nnue_refresh(Game* game) {
+    for (PieceColor perspective = COLOR_WHITE; perspective <= COLOR_BLACK; perspective++)
+        memcpy(game->accumulator->values[perspective], game->nnue->ft_bias, NNUE_HIDDEN * sizeof(int16_t));
+    Bitboard occupied = board_occupied(&game->board);
+    while (occupied) {
+        int index = bb_pop_lsb(&occupied);
+        update(game, board_piece_at(&game->board, index), index, 1);
+    }
+}
+
+void nnue_attach(Game* game, const Network* net, Accumulator* acc) {
+    game->nnue = net;
+    game->accumulator = net ? acc : NULL;
+    if (net) nnue_refresh(game);
+}
+
+// Layers after the accumulator. `us` and `them` are the accumulators from the
+// point of view of the side to move and of its opponent.
+static int forward_scalar(const Network* net, const int16_t* us, const int16_t* them) {
+    uint8_t input[2 * NNUE_HIDDEN];
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int a = us[i] < 0 ? 0 : us[i] > NNUE_ACTIVATION_MAX ? NNUE_ACTIVATION_MAX : us[i];
+        int b = them[i] < 0 ? 0 : them[i] > NNUE_ACTIVATION_MAX ? NNUE_ACTIVATION_MAX : them[i];
+        input[i] = a;
+        input[NNUE_HIDDEN + i] = b;
+    }
+
+    int32_t output = *net->l2_bias;
+    for (int j = 0; j < NNUE_L1; j++) {
+        const int8_t* weights = &net->l1_weights[j * 2 * NNUE_HIDDEN];
+        int32_t sum = 0;
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+            sum += input[i] * weights[i];
+        int hidden = (sum + net->l1_bias[j]) >> NNUE_L1_SHIFT;
+        hidden = hidden < 0 ? 0 : hidden > NNUE_ACTIVATION_MAX ? NNUE_ACTIVATION_MAX : hidden;
+        output += hidden * net->l2_weights[j];
+    }
+    return output;
+}
+
+#if defined(__x86_64__)
+// Clips 32 accumulator values to [0, 127] and packs them to bytes
+__attribute__((target("avx2")))
+static inline __m256i activate_avx2(const int16_t* acc) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(NNUE_ACTIVATION_MAX);
+    __m256i a = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((const __m256i*)acc), zero), max);
+    __m256i b = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((const __m256i*)(acc + 16)), zero), max);
+    // Packing works on each 128 bit half, put the quarters back in order
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+}
+
+__attribute__((target("avx2")))
+static int forward_avx2(const Network* net, const int16_t* us, const int16_t* them) {
+    __m256i input[2 * NNUE_HIDDEN / 32];
+    for (int i = 0; i < NNUE_HIDDEN / 32; i++) {
+        input[i] = activate_avx2(us + 32 * i);
+        input[NNUE_HIDDEN / 32 + i] = activate_avx2(them + 32 * i);
+    }
+
+    const __m256i ones = _mm256_set1_epi16(1);
+    int32_t output = *net->l2_bias;
+    for (int j = 0; j < NNUE_L1; j++) {
+        const int8_t* weights = &net->l1_weights[j * 2 * NNUE_HIDDEN];
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < 2 * NNUE_HIDDEN / 32; i++) {
+            __m256i w = _mm256_loadu_si256((const __m256i*)(weights + 32 * i));
+            // Activations are at most 127, so pairs of products never
+            // saturate 16 bits
+            __m256i products = _mm256_maddubs_epi16(input[i], w);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+        int hidden = (_mm_cvtsi128_si32(half) + net->l1_bias[j]) >> NNUE_L1_SHIFT;
+        hidden = hidden < 0 ? 0 : hidden > NNUE_ACTIVATION_MAX ? NNUE_ACTIVATION_MAX : hidden;
+        output += hidden * net->l2_weights[j];
+    }
+    return output;
+}
+#endif
+
+int nnue_evaluate(const Game* game) {
+    const Network* net = game->nnue;
+    const int16_t* us = game->accumulator->values[game->turn];
+    const int16_t* them = game->accumulator->values[opposite(game->turn)];
+#if defined(__x86_64__)
+    if (net->avx2) return forward_avx2(net, us, them);
+#endif
+    return forward_scalar(net, us, them);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "common.h"
+
+// Efficiently updatable neural network: a piece on a square is one of the
+// NNUE_INPUTS features, seen from each side's point of view. The first layer,
+// feature weights summed into the accumulator, is updated piece by piece as
+// moves are made; only the small layers after it run for each evaluation.
+//
+//     NNUE_INPUTS -> NNUE_HIDDEN (for each side, int16)
+//     2 * NNUE_HIDDEN -> NNUE_L1 (int8 weights on activations in [0, 127])
+//     NNUE_L1 -> 1 (int8 weights), the score in centipawns
+//
+// source: https://www.chessprogramming.org/NNUE
+#define NNUE_INPUTS (2 * NUM_PIECE_KINDS * 64)
+#define NNUE_HIDDEN 256
+#define NNUE_L1 32
+// Activations are clipped to [0, NNUE_ACTIVATION_MAX]
+#define NNUE_ACTIVATION_MAX 127
+// The first dense layer's outputs are divided by 2 ^ NNUE_L1_SHIFT before
+// being clipped
+#define NNUE_L1_SHIFT 4
+
+#define NNUE_MAGIC "ECNN"
+#define NNUE_VERSION 1
+
+// Layout of a weights file, all little endian. Each array starts right after
+// the previous one:
+//
+//     header (NNUE_HEADER_SIZE bytes)
+//     int16 ft_bias[NNUE_HIDDEN]
+//     int16 ft_weights[NNUE_INPUTS][NNUE_HIDDEN]
+//     int32 l1_bias[NNUE_L1]
+//     int8  l1_weights[NNUE_L1][2 * NNUE_HIDDEN]
+//     int32 l2_bias
+//     int8  l2_weights[NNUE_L1]
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t inputs;
+    uint32_t hidden;
+    uint32_t l1;
+} NetworkHeader;
+
+// Padded so that the arrays are 64 byte aligned in the mapped file
+#define NNUE_HEADER_SIZE 64
+
+#define NNUE_FILE_SIZE (NNUE_HEADER_SIZE                          \
+        + NNUE_HIDDEN * 2 + NNUE_INPUTS * NNUE_HIDDEN * 2         \
+        + NNUE_L1 * 4 + NNUE_L1 * 2 * NNUE_HIDDEN                 \
+        + 4 + NNUE_L1)
+
+// Weights point straight into the read-only mapping of the file, so any
+// number of games and threads may share a network.
+struct Network {
+    void* mapping;
+    size_t size;
+    const int16_t* ft_bias;
+    const int16_t* ft_weights;
+    const int32_t* l1_bias;
+    const int8_t* l1_weights;
+    const int32_t* l2_bias;
+    const int8_t* l2_weights;
+    // Whether the AVX2 kernels are used, picked by `nnue_load` from CPUID and
+    // always false off x86-64
+    bool avx2;
+};
+
+// Maps the weights file at `path`, which must match the architecture above
+Result nnue_load(Network* this, const char* path);
+
+void nnue_free(Network* net);
+
+// First layer outputs of the network, from the point of view of each color
+struct Accumulator {
+    int16_t values[2][NNUE_HIDDEN];
+};
+
+// Evaluates `game` with `net` from now on, keeping its first layer in `acc`,
+// or with the piece-square tables when `net` is NULL. A copy of the game
+// shares `acc`, so it must be attached to an accumulator of its own, or
+// detached, before moves are made on it.
+void nnue_attach(Game* game, const Network* net, Accumulator* acc);
+
+// Computes the accumulator of `game` from scratch
+void nnue_refresh(Game* game);
+
+// Updates the accumulator of `game` for a piece appearing on or leaving
+// `index`, called by `make_move` and `unmake_move`
+void nnue_add_piece(Game* game, Piece piece, int index);
+void nnue_remove_piece(Game* game, Piece piece, int index);
+
+// Score of the position from the point of view of the side to move, in
+// centipawns
+int nnue_evaluate(const Game* game);
@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include "common.h"
+#include "perft_cache.h"
+
+Result perft_cache_init(PerftCache* this, size_t megabytes) {
+    size_t count = 1;
+    while (2 * count * sizeof(PerftEntry) <= megabytes * 1024 * 1024)
+        count *= 2;
+    this->entries = malloc(count * sizeof(PerftEntry));
+    ASSERT_OR(this->entries, LIBC);
+    this->mask = count - 1;
+    atomic_init(&this->probes, 0);
+    atomic_init(&this->hits, 0);
+    perft_cache_clear(this);
+    return RESULT_OK;
+}
+
+void perft_cache_clear(PerftCache* cache) {
+    memset(cache->entries, 0, (cache->mask + 1) * sizeof(PerftEntry));
+}
+
+// The same position at different depths goes to different slots
+static inline PerftEntry* perft_cache_slot(PerftCache* cache, uint64_t hash, int depth) {
+    return &cache->entries[(hash ^ (depth * 0x9E3779B97F4A7C15ULL)) & cache->mask];
+}
+
+bool perft_cache_probe(PerftCache* cache, uint64_t hash, int depth, uint64_t* nodes) {
+    PerftEntry* entry = perft_cache_slot(cache, hash, depth);
+    uint64_t key = atomic_load_explicit(&entry->key, memory_order_relaxed);
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    if ((key ^ data) != hash || (int)(data & ((1 << PERFT_DEPTH_BITS) - 1)) != depth)
+        return false;
+    *nodes = data >> PERFT_DEPTH_BITS;
+    return true;
+}
+
+void perft_cache_store(PerftCache* cache, uint64_t hash, int depth, uint64_t nodes) {
+    PerftEntry* entry = perft_cache_slot(cache, hash, depth);
+    uint64_t data = (nodes << PERFT_DEPTH_BITS) | depth;
+    atomic_store_explicit(&entry->key, hash ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+void perft_cache_count(PerftCache* cache, uint64_t probes, uint64_t hits) {
+    atomic_fetch_add(&cache->probes, probes);
+    atomic_fetch_add(&cache->hits, hits);
+}
+
+size_t perft_cache_size(PerftCache* cache) {
+    return (cache->mask + 1) * sizeof(PerftEntry);
+}
+
+void perft_cache_free(PerftCache* cache) {
+    free(cache->entries);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+
+// Depths are stored in the low bits of an entry, the node count in the rest
+#define PERFT_DEPTH_BITS 8
+
+// An entry keeps the key xored with its data. Writes from two threads may
+// interleave and leave the key of one with the data of the other, which then
+// fails the check on lookup and reads as a miss, so no locks are needed.
+// source: https://www.chessprogramming.org/Shared_Hash_Table#Lockless
+typedef struct {
+    atomic_uint_least64_t key;
+    atomic_uint_least64_t data;
+} PerftEntry;
+
+// Fixed size table of the node counts of subtrees, keyed by the Zobrist hash
+// of the position and the remaining depth. Any number of threads may use it at
+// once.
+typedef struct {
+    PerftEntry* entries;
+    size_t mask;
+    // Statistics, added in bulk by `perft_cache_count` to keep threads from
+    // fighting over them on every probe
+    atomic_uint_least64_t probes;
+    atomic_uint_least64_t hits;
+} PerftCache;
+
+// Uses the largest power of two number of entries that fits in `megabytes`
+Result perft_cache_init(PerftCache* this, size_t megabytes);
+
+// Forgets every entry, the statistics are kept
+void perft_cache_clear(PerftCache* cache);
+
+bool perft_cache_probe(PerftCache* cache, uint64_t hash, int depth, uint64_t* nodes);
+
+// Always replaces whatever was in the slot
+void perft_cache_store(PerftCache* cache, uint64_t hash, int depth, uint64_t nodes);
+
+void perft_cache_count(PerftCache* cache, uint64_t probes, uint64_t hits);
+
+size_t perft_cache_size(PerftCache* cache);
+
+void perft_cache_free(PerftCache* cache);
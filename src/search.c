@@ -0,0 +1,533 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "search.h"
+#include "moves.h"
+#include "eval.h"
+#include "tt.h"
+
+// Nodes between two looks at the clock
+#define CHECK_TIME_INTERVAL 1024
+// How often a ponder search that can't go deeper checks for the ponderhit
+#define PONDER_WAIT_NS 1000000
+// History scores are halved once one gets past this, so that recent cutoffs
+// weigh more than old ones
+#define HISTORY_SCORE_MAX (1 << 16)
+
+// Without `movestogo`, the time left is shared as if this many moves remained
+#define TIME_MOVES_TO_GO 30
+// How much longer than planned a move may take at most
+#define TIME_HARD_FACTOR 4
+// Kept off the clock for the time the moves take to get to the server
+#define TIME_OVERHEAD_MS 50
+
+// Null move pruning searches this much shallower, and more at higher depths
+#define NULL_MOVE_REDUCTION 2
+#define NULL_MOVE_MIN_DEPTH 3
+// Late moves are only reduced this far from the leaves, after this many
+// moves were searched
+#define LMR_MIN_DEPTH 3
+#define LMR_MIN_MOVES 3
+// Centipawns per ply left that a quiet move is assumed to gain at most
+#define FUTILITY_DEPTH 3
+#define FUTILITY_MARGIN 150
+#define RAZOR_DEPTH 2
+#define RAZOR_MARGIN 300
+
+const SearchOptions search_default_options = {
+    .quiescence = true,
+    .sort_captures = true,
+    .killers = true,
+    .history = true,
+    .null_move = true,
+    .late_move_reductions = true,
+    .futility = true,
+};
+
+// source: https://www.chessprogramming.org/Perft_Results
+const char* const bench_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+const size_t n_bench_positions = sizeof(bench_positions) / sizeof(bench_positions[0]);
+
+void search_init(Search* this, const Game* game, UciGo limits, TranspositionTable* tt, FILE* out) {
+    this->game = *game;
+    nnue_attach(&this->game, game->nnue, &this->accumulator);
+    this->limits = limits;
+    this->tt = tt;
+    atomic_init(&this->stop, false);
+    atomic_init(&this->ponderhit, false);
+    atomic_init(&this->nodes, 0);
+    this->options = search_default_options;
+    this->thread_id = 0;
+    this->threads = NULL;
+    this->n_threads = 1;
+    this->pv_length[0] = 0;
+    this->n_played = 0;
+    memset(this->killers, 0, sizeof(this->killers));
+    memset(this->history, 0, sizeof(this->history));
+    this->depth = 0;
+    this->score = 0;
+    this->best_move = NULL_MOVE;
+    this->ponder_move = NULL_MOVE;
+    this->out = out;
+}
+
+void search_set_played(Search* search, const uint64_t* hashes, int n_hashes) {
+    // Only the most recent can repeat
+    if (n_hashes > UCI_POSITION_HASHES) {
+        hashes += n_hashes - UCI_POSITION_HASHES;
+        n_hashes = UCI_POSITION_HASHES;
+    }
+    memcpy(search->played, hashes, n_hashes * sizeof(uint64_t));
+    search->n_played = n_hashes;
+}
+
+void search_stop(Search* search) {
+    atomic_store(&search->stop, true);
+}
+
+void search_ponderhit(Search* search) {
+    atomic_store(&search->ponderhit, true);
+}
+
+uint64_t search_nodes(const Search* search) {
+    if (!search->threads)
+        return atomic_load_explicit(&search->nodes, memory_order_relaxed);
+    uint64_t nodes = 0;
+    for (int i = 0; i < search->n_threads; i++)
+        nodes += atomic_load_explicit(&search->threads[i].nodes, memory_order_relaxed);
+    return nodes;
+}
+
+uint64_t search_elapsed_ms(const Search* search) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - search->start.tv_sec) * 1000 + (now.tv_nsec - search->start.tv_nsec) / 1000000;
+}
+
+// Milliseconds the search has been on its own clock: since `search_run`
+// started, or since the ponderhit when pondering, and 0 until then
+static uint64_t clock_ms(Search* search) {
+    if (search->pondering) {
+        if (!atomic_load(&search->ponderhit)) return 0;
+        search->pondering = false;
+        search->ponderhit_ms = search_elapsed_ms(search);
+    }
+    return search_elapsed_ms(search) - search->ponderhit_ms;
+}
+
+// Whether the search must unwind. Called once per node, but the clock is only
+// read every CHECK_TIME_INTERVAL nodes.
+static bool should_stop(Search* search) {
+    // The first iteration always completes, so there is a move to play
+    if (search->best_move == NULL_MOVE) return false;
+    uint64_t nodes = atomic_load_explicit(&search->nodes, memory_order_relaxed);
+    if (search->hard_ms > 0 && nodes % CHECK_TIME_INTERVAL == 0
+            && clock_ms(search) >= search->hard_ms)
+        search_stop(search);
+    if (search->limits.nodes > 0 && nodes >= (uint64_t)search->limits.nodes)
+        search_stop(search);
+    return atomic_load_explicit(&search->stop, memory_order_relaxed);
+}
+
+// Fifty moves without a capture or pawn move, or a position repeated since
+// the root or played before it. Only positions with the same side to move
+// since the last irreversible move can repeat.
+static bool is_draw(Search* search, int ply) {
+    Game* game = &search->game;
+    if (game->halfmove_clock >= 100) return true;
+    for (int back = 4; back <= game->halfmove_clock; back += 2) {
+        uint64_t hash;
+        if (back <= ply)
+            hash = search->hashes[ply - back];
+        else if (back - ply <= search->n_played)
+            hash = search->played[search->n_played - (back - ply)];
+        else
+            break;
+        if (hash == game->hash)
+            return true;
+    }
+    return false;
+}
+
+// Mate scores count plies from the root, but the table is shared by every
+// path to a position, so they are stored counting from the position instead
+static int score_to_tt(int score, int ply) {
+    if (score >= SCORE_MATE_BOUND) return score + ply;
+    if (score <= -SCORE_MATE_BOUND) return score - ply;
+    return score;
+}
+
+static int score_from_tt(int score, int ply) {
+    if (score >= SCORE_MATE_BOUND) return score - ply;
+    if (score <= -SCORE_MATE_BOUND) return score + ply;
+    return score;
+}
+
+static void count_node(Search* search) {
+    // Only this thread writes it, a plain increment is enough
+    uint64_t nodes = atomic_load_explicit(&search->nodes, memory_order_relaxed);
+    atomic_store_explicit(&search->nodes, nodes + 1, memory_order_relaxed);
+}
+
+// A quiet `move` caused a cutoff `depth` plies from the leaves
+static void update_quiet_order(Search* search, int ply, int depth, Move move) {
+    Move* killers = search->killers[ply];
+    if (killers[0] != move) {
+        memmove(&killers[1], &killers[0], (MAX_KILLERS - 1) * sizeof(Move));
+        killers[0] = move;
+    }
+
+    int (*history)[64] = search->history[search->game.turn];
+    int* score = &history[move_origin(move)][move_destination(move)];
+    *score += depth * depth;
+    if (*score > HISTORY_SCORE_MAX) {
+        for (int origin = 0; origin < 64; origin++)
+            for (int destination = 0; destination < 64; destination++)
+                history[origin][destination] /= 2;
+    }
+}
+
+static int quiescence(Search* search, int ply, int alpha, int beta);
+
+// Only captures are searched, unless in check, and the side to move may stand
+// pat on the static evaluation instead: the score of a leaf is not trusted
+// while pieces hang. The node itself isn't counted, see `quiescence`.
+// source: https://www.chessprogramming.org/Quiescence_Search
+static int quiescence_search(Search* search, int ply, int alpha, int beta) {
+    Game* game = &search->game;
+    search->pv_length[ply] = 0;
+    if (ply == MAX_PLY - 1) return evaluate(game);
+
+    bool in_check = is_in_check(game);
+    int best = -SCORE_INFINITE;
+    if (!in_check) {
+        best = evaluate(game);
+        if (best >= beta) return best;
+        if (best > alpha) alpha = best;
+    }
+
+    MoveOrder order = { .sort_captures = search->options.sort_captures };
+    MovePicker picker;
+    move_picker_init(&picker, game, NULL_MOVE, in_check ? GEN_ALL : GEN_CAPTURES, &order);
+    Move move;
+    while ((move = move_picker_next(&picker)) != NULL_MOVE) {
+        // Captures that lose material do worse than standing pat
+        if (!in_check && picker.stage == PICK_BAD_CAPTURES) break;
+        MoveHistory hist = make_move(game, move);
+        int score = -quiescence(search, ply + 1, -beta, -alpha);
+        unmake_move(game, hist);
+        if (should_stop(search)) return 0;
+
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) break;
+            }
+        }
+    }
+
+    if (best == -SCORE_INFINITE)
+        return -SCORE_MATE + ply;
+    return best;
+}
+
+static int quiescence(Search* search, int ply, int alpha, int beta) {
+    count_node(search);
+    return quiescence_search(search, ply, alpha, beta);
+}
+
+// Whether the side to move has anything but pawns and its king. Without, a
+// pass may well be its best move (zugzwang), so null move pruning is unsound.
+static bool has_non_pawn_material(const Game* game) {
+    const Board* board = &game->board;
+    Bitboard pawns_and_kings = board->kinds[piece_kind_index(PIECE_PAWN)] | board->kinds[piece_kind_index(PIECE_KING)];
+    return board->colors[game->turn] & ~pawns_and_kings;
+}
+
+static int alpha_beta(Search* search, int depth, int ply, int alpha, int beta) {
+    Game* game = &search->game;
+    const SearchOptions* options = &search->options;
+    search->pv_length[ply] = 0;
+    search->hashes[ply] = game->hash;
+    if (depth <= 0 && options->quiescence && (ply == 0 || !is_draw(search, ply)))
+        return quiescence(search, ply, alpha, beta);
+    count_node(search);
+
+    if (ply > 0 && is_draw(search, ply)) return SCORE_DRAW;
+    if (depth <= 0 || ply == MAX_PLY - 1) return evaluate(game);
+
+    // The best move of the previous iteration is searched first
+    Move hash_move = ply == 0 ? search->best_move : NULL_MOVE;
+    TTHit hit;
+    if (tt_probe(search->tt, game->hash, &hit)) {
+        int score = score_from_tt(hit.score, ply);
+        // The root always searches, so that there is a move to play
+        if (ply > 0 && hit.depth >= depth) {
+            if (hit.bound == TT_BOUND_EXACT
+                    || (hit.bound == TT_BOUND_LOWER && score >= beta)
+                    || (hit.bound == TT_BOUND_UPPER && score <= alpha))
+                return score;
+        }
+        if (hit.move != NULL_MOVE) hash_move = hit.move;
+    }
+
+    bool in_check = is_in_check(game);
+    // Forward pruning needs a score to compare against, and isn't done at the
+    // root nor when mates are at stake
+    bool prunable = ply > 0 && !in_check && alpha > -SCORE_MATE_BOUND && beta < SCORE_MATE_BOUND
+                 && (options->null_move || options->futility);
+    int static_eval = prunable ? evaluate(game) : 0;
+
+    // Razoring: far below alpha near the leaves, only captures could make up
+    // for it. This node was counted already.
+    if (prunable && options->futility && depth <= RAZOR_DEPTH && static_eval + RAZOR_MARGIN * depth <= alpha) {
+        int score = quiescence_search(search, ply, alpha, beta);
+        if (should_stop(search)) return 0;
+        if (score <= alpha) {
+            tt_store(search->tt, game->hash, NULL_MOVE, score_to_tt(score, ply), depth, TT_BOUND_UPPER);
+            return score;
+        }
+    }
+
+    // Null move pruning: if passing still fails high on a shallower search,
+    // a real move surely would too. Never twice in a row.
+    if (prunable && options->null_move && depth >= NULL_MOVE_MIN_DEPTH && static_eval >= beta
+            && search->line[ply - 1] != NULL_MOVE && has_non_pawn_material(game)) {
+        int reduction = NULL_MOVE_REDUCTION + depth / 6;
+        MoveHistory hist = make_null_move(game);
+        search->line[ply] = NULL_MOVE;
+        int score = -alpha_beta(search, depth - 1 - reduction, ply + 1, -beta, -beta + 1);
+        unmake_null_move(game, hist);
+        if (should_stop(search)) return 0;
+        // A mate found after a pass isn't a real one
+        if (score >= beta) return score >= SCORE_MATE_BOUND ? beta : score;
+    }
+
+    // Futility pruning: near the leaves, quiet moves can't bring a score this
+    // far below alpha back up
+    bool futile = prunable && options->futility && depth <= FUTILITY_DEPTH
+               && static_eval + FUTILITY_MARGIN * depth <= alpha;
+
+    int original_alpha = alpha;
+    Move best_move = NULL_MOVE;
+    MoveOrder order = {
+        .sort_captures = options->sort_captures,
+        .history = options->history ? search->history[game->turn] : NULL,
+    };
+    if (options->killers)
+        memcpy(order.killers, search->killers[ply], sizeof(order.killers));
+    MovePicker picker;
+    move_picker_init(&picker, game, hash_move, GEN_ALL, &order);
+
+    int best = -SCORE_INFINITE;
+    int searched = 0;
+    Move move;
+    while ((move = move_picker_next(&picker)) != NULL_MOVE) {
+        bool quiet = move_gen_kind(game, move) == GEN_QUIETS;
+        MoveHistory hist = make_move(game, move);
+        search->line[ply] = move;
+        bool gives_check = is_in_check(game);
+
+        if (futile && quiet && searched > 0 && !gives_check) {
+            unmake_move(game, hist);
+            if (static_eval + FUTILITY_MARGIN * depth > best)
+                best = static_eval + FUTILITY_MARGIN * depth;
+            continue;
+        }
+
+        int score;
+        // Late move reductions: the moves the picker yields last, after the
+        // hash move, good captures and killers, rarely turn out best, so they
+        // are searched shallower with a null window first, and again at full
+        // depth only if they beat alpha
+        bool late = picker.stage == PICK_QUIETS || picker.stage == PICK_BAD_CAPTURES;
+        if (options->late_move_reductions && late && depth >= LMR_MIN_DEPTH && searched >= LMR_MIN_MOVES
+                && !in_check && !gives_check) {
+            int reduction = searched >= 2 * LMR_MIN_MOVES && depth >= 2 * LMR_MIN_DEPTH ? 2 : 1;
+            score = -alpha_beta(search, depth - 1 - reduction, ply + 1, -alpha - 1, -alpha);
+            if (score > alpha && !should_stop(search))
+                score = -alpha_beta(search, depth - 1, ply + 1, -beta, -alpha);
+        } else {
+            score = -alpha_beta(search, depth - 1, ply + 1, -beta, -alpha);
+        }
+        unmake_move(game, hist);
+        if (should_stop(search)) return 0;
+        searched++;
+
+        if (score > best) {
+            best = score;
+            best_move = move;
+            if (score > alpha) {
+                alpha = score;
+                search->pv[ply][0] = move;
+                memcpy(&search->pv[ply][1], search->pv[ply + 1], search->pv_length[ply + 1] * sizeof(Move));
+                search->pv_length[ply] = search->pv_length[ply + 1] + 1;
+                if (alpha >= beta) {
+                    if (quiet)
+                        update_quiet_order(search, ply, depth, move);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (best == -SCORE_INFINITE)
+        return in_check ? -SCORE_MATE + ply : SCORE_DRAW;
+
+    TTBound bound = best >= beta ? TT_BOUND_LOWER : best > original_alpha ? TT_BOUND_EXACT : TT_BOUND_UPPER;
+    // Only the move that raised alpha is worth trying first next time
+    tt_store(search->tt, game->hash, bound == TT_BOUND_UPPER ? NULL_MOVE : best_move, score_to_tt(best, ply), depth, bound);
+    return best;
+}
+
+// Writes an `info` line about the last completed iteration
+static void report(Search* search) {
+    if (!search->out) return;
+    uint64_t ms = search_elapsed_ms(search);
+    uint64_t nodes = search_nodes(search);
+    uint64_t nps = ms > 0 ? nodes * 1000 / ms : 0;
+
+    fprintf(search->out, "info depth %d score ", search->depth);
+    if (search->score >= SCORE_MATE_BOUND)
+        fprintf(search->out, "mate %d", (SCORE_MATE - search->score + 1) / 2);
+    else if (search->score <= -SCORE_MATE_BOUND)
+        fprintf(search->out, "mate %d", -(SCORE_MATE + search->score) / 2);
+    else
+        fprintf(search->out, "cp %d", search->score);
+    fprintf(search->out, " nodes %lu nps %lu time %lu hashfull %d pv",
+            nodes, nps, ms, tt_hashfull(search->tt));
+    for (int i = 0; i < search->pv_length[0]; i++) {
+        char uci[MOVE_UCI_LENGTH];
+        move_to_uci(search->pv[0][i], uci);
+        fprintf(search->out, " %s", uci);
+    }
+    fprintf(search->out, "\n");
+    fflush(search->out);
+}
+
+// Sets the deadlines of the search from its limits. With a clock, a move gets
+// its share of the time left until the next time control plus most of the
+// increment, that's the soft deadline. It may go over it, up to the hard
+// deadline, to finish an iteration, but no iteration starts past half the soft
+// deadline since it would likely not finish in time.
+static void plan_time(Search* search) {
+    const UciGo* limits = &search->limits;
+    PieceColor color = search->game.turn;
+    search->soft_ms = 0;
+    search->hard_ms = limits->movetime > 0 ? limits->movetime : 0;
+    // Without a clock for either side there's nothing to plan
+    if (limits->infinite || (limits->time[COLOR_WHITE] <= 0 && limits->time[COLOR_BLACK] <= 0)) return;
+
+    int64_t left = limits->time[color] - TIME_OVERHEAD_MS;
+    if (left < 1) left = 1;
+    int moves = limits->movestogo > 0 && limits->movestogo < TIME_MOVES_TO_GO ? limits->movestogo : TIME_MOVES_TO_GO;
+    int64_t soft = left / moves + limits->increment[color] * 3 / 4;
+    // 0 would mean no deadline at all
+    if (soft < 1) soft = 1;
+    int64_t hard = soft * TIME_HARD_FACTOR < left ? soft * TIME_HARD_FACTOR : left;
+    if (soft > hard) soft = hard;
+    search->soft_ms = soft;
+    if (search->hard_ms == 0 || (uint64_t)hard < search->hard_ms)
+        search->hard_ms = hard;
+}
+
+// Reply to the best move from the transposition table, for when the cutoffs
+// left the principal variation a single move long
+static Move expected_reply(Search* search) {
+    Game game = search->game;
+    // The copy would move the search's accumulator along
+    nnue_attach(&game, NULL, NULL);
+    make_move(&game, search->best_move);
+    TTHit hit;
+    if (!tt_probe(search->tt, game.hash, &hit) || hit.move == NULL_MOVE) return NULL_MOVE;
+    Move reply = hit.move;
+    // A different position may share the entry
+    return is_move_valid(&reply, &game) ? reply : NULL_MOVE;
+}
+
+// After the first depth, helper `i` jumps `1 + ctz(i)` plies ahead of the main
+// thread: half the helpers lead by one ply, a quarter by two, and so on. None
+// repeats the main thread's iterations, and the deeper ones fill the table
+// ahead of it. Skipping depths all along measured worse, as each iteration
+// then lacks the move ordering of the one before.
+// source: https://www.chessprogramming.org/Lazy_SMP
+static bool skip_depth(const Search* search, int depth) {
+    if (search->thread_id == 0) return false;
+    int lead = 1 + __builtin_ctz(search->thread_id);
+    return depth > 1 && depth <= 1 + lead;
+}
+
+Move search_run(Search* search) {
+    clock_gettime(CLOCK_MONOTONIC, &search->start);
+    search->pondering = search->limits.ponder;
+    search->ponderhit_ms = 0;
+    plan_time(search);
+    int max_depth = search->limits.depth > 0 && search->limits.depth < MAX_PLY ? search->limits.depth : MAX_PLY - 1;
+
+    for (int depth = 1; depth <= max_depth; depth++) {
+        if (skip_depth(search, depth)) continue;
+        int score = alpha_beta(search, depth, 0, -SCORE_INFINITE, SCORE_INFINITE);
+        // An interrupted iteration may not have looked at the best move yet,
+        // but the first one is never interrupted
+        if (search->best_move != NULL_MOVE && atomic_load(&search->stop)) break;
+        // No legal move at the root
+        if (search->pv_length[0] == 0) break;
+
+        search->depth = depth;
+        search->score = score;
+        search->best_move = search->pv[0][0];
+        search->ponder_move = search->pv_length[0] > 1 ? search->pv[0][1] : NULL_MOVE;
+        report(search);
+        // Nothing deeper will find a faster mate
+        if (score >= SCORE_MATE_BOUND || score <= -SCORE_MATE_BOUND) {
+            if (!search->limits.infinite) break;
+        }
+        if (search->soft_ms > 0 && !search->pondering && clock_ms(search) >= search->soft_ms / 2) break;
+    }
+    // The move can't be played before the opponent's
+    struct timespec wait = { .tv_sec = 0, .tv_nsec = PONDER_WAIT_NS };
+    while (search->pondering && !atomic_load(&search->ponderhit) && !atomic_load(&search->stop))
+        nanosleep(&wait, NULL);
+    if (search->best_move != NULL_MOVE && search->ponder_move == NULL_MOVE)
+        search->ponder_move = expected_reply(search);
+    return search->best_move;
+}
+
+static void* helper_main(void* arg) {
+    search_run(arg);
+    return NULL;
+}
+
+Move search_run_threads(Search* searches, int n_threads) {
+    Search* main = &searches[0];
+    main->threads = searches;
+    main->n_threads = n_threads;
+
+    pthread_t threads[n_threads];
+    int started = 1;
+    for (int i = 1; i < n_threads; i++) {
+        Search* helper = &searches[i];
+        helper->thread_id = i;
+        // Helpers go on until the main thread is done
+        helper->limits = (UciGo){ .infinite = true };
+        helper->out = NULL;
+        if (pthread_create(&threads[i], NULL, helper_main, helper) != 0) break;
+        started++;
+    }
+
+    Move best = search_run(main);
+    for (int i = 1; i < started; i++)
+        search_stop(&searches[i]);
+    for (int i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+    return best;
+}
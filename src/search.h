@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <time.h>
+
+#include "common.h"
+#include "uci.h"
+#include "tt.h"
+#include "moves.h"
+#include "nnue.h"
+
+// Deepest line the search may look at
+#define MAX_PLY 64
+
+#define SCORE_INFINITE 32001
+// Score of mating right now, mating in `n` plies scores SCORE_MATE - n
+#define SCORE_MATE 32000
+// Scores beyond this are mates
+#define SCORE_MATE_BOUND (SCORE_MATE - MAX_PLY)
+#define SCORE_DRAW 0
+
+// Techniques the search uses on top of plain alpha-beta, all on by default.
+// Turning them off shows what each is worth.
+typedef struct {
+    // Search captures past the nominal depth until the position is quiet
+    bool quiescence;
+    // See `MoveOrder`
+    bool sort_captures;
+    bool killers;
+    bool history;
+    // Prune the moves after a pass that still fails high
+    bool null_move;
+    // Search the moves yielded last by the picker shallower
+    bool late_move_reductions;
+    // Prune quiet moves near the leaves when far below alpha (futility
+    // pruning), or drop into the quiescence search (razoring)
+    bool futility;
+} SearchOptions;
+
+extern const SearchOptions search_default_options;
+
+// Positions searched by the `bench` command and `search_bench`
+extern const char* const bench_positions[];
+extern const size_t n_bench_positions;
+
+// Iterative deepening alpha-beta search of a single position. Only the thread
+// running `search_run` may touch it, apart from `search_stop` and reading
+// `nodes`.
+// source: https://www.chessprogramming.org/Iterative_Deepening
+typedef struct Search Search;
+struct Search {
+    Game game;
+    // Where `game` keeps the first layer of its network, if it has one
+    Accumulator accumulator;
+    UciGo limits;
+    TranspositionTable* tt;
+    // Set from any thread to end the search as soon as possible
+    atomic_bool stop;
+    struct timespec start;
+    // Deadlines in milliseconds from `start` set by the time manager, 0 when
+    // there's none. Past half the soft one no iteration starts, at the hard one
+    // the search stops.
+    uint64_t soft_ms;
+    uint64_t hard_ms;
+    // Searching on the opponent's time after `go ponder`: the deadlines only
+    // count from the ponderhit, which `search_ponderhit` sets from any thread
+    // and the search notices at `ponderhit_ms` from `start`
+    bool pondering;
+    atomic_bool ponderhit;
+    uint64_t ponderhit_ms;
+    atomic_uint_least64_t nodes;
+    SearchOptions options;
+
+    // Position among the threads of `search_run_threads`, 0 when searching
+    // alone. Helpers search ahead of the main thread by a number of plies that
+    // depends on it, so that they don't all search the same tree at once.
+    int thread_id;
+    // The searches of all the threads, set for the main one only so that it
+    // reports their nodes too
+    Search* threads;
+    int n_threads;
+
+    // Triangular table of principal variations: `pv[ply]` is the best line
+    // found from the position at `ply`, `pv_length[ply]` moves long
+    Move pv[MAX_PLY][MAX_PLY];
+    int pv_length[MAX_PLY];
+    // Hashes of the positions along the current line, to tell repetitions
+    uint64_t hashes[MAX_PLY];
+    // and of the positions played before the root, oldest first
+    uint64_t played[UCI_POSITION_HASHES];
+    int n_played;
+    // Moves from the root to the current position, NULL_MOVE for a pass
+    Move line[MAX_PLY];
+    // Move ordering, see `MoveOrder`. History is indexed by the side to move.
+    Move killers[MAX_PLY][MAX_KILLERS];
+    int history[2][64][64];
+
+    // Result of the deepest completed iteration
+    int depth;
+    int score;
+    Move best_move;
+    // The reply expected to `best_move`, NULL_MOVE if none is known
+    Move ponder_move;
+
+    // Where `info` lines are written after each iteration, or NULL
+    FILE* out;
+};
+
+// Searches with `search_default_options`, change `options` afterwards to
+// search differently. A network attached to `game` is attached to the
+// search's own accumulator. With `limits.ponder` the search starts pondering.
+void search_init(Search* this, const Game* game, UciGo limits, TranspositionTable* tt, FILE* out);
+
+// The positions played before the game of `search_init`, oldest first, as
+// parsed from `position`: returning to one of them is a draw too
+void search_set_played(Search* search, const uint64_t* hashes, int n_hashes);
+
+// Searches deeper and deeper until a limit is hit or `search_stop` is called,
+// and returns the best move found. The first iteration always completes, so
+// the move is NULL_MOVE only when there is no legal move. While pondering it
+// doesn't return before `search_ponderhit` or `search_stop`, even once it
+// can't search any deeper.
+Move search_run(Search* search);
+
+// Lazy SMP: `searches[0]` searches on this thread, every other search on a
+// thread of its own, and they only share the transposition table. All must
+// have been set up by `search_init` with the same position. Once the first
+// search finishes the others are stopped, and its best move is returned.
+// source: https://www.chessprogramming.org/Lazy_SMP
+Move search_run_threads(Search* searches, int n_threads);
+
+void search_stop(Search* search);
+
+// The opponent played the move pondered on: the search goes on, now with the
+// deadlines of its limits
+void search_ponderhit(Search* search);
+
+// Nodes searched by `search` and, for the main thread of
+// `search_run_threads`, its helpers
+uint64_t search_nodes(const Search* search);
+
+// Milliseconds since `search_run` started
+uint64_t search_elapsed_ms(const Search* search);
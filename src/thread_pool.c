@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <string.h>
+
+#include "common.h"
+#include "thread_pool.h"
+
+#define INITIAL_DEQUE_CAPACITY 64
+
+typedef struct {
+    ThreadPool* pool;
+    int index;
+} WorkerArgs;
+
+// Index of the worker running on this thread, or -1 outside of a pool
+static _Thread_local int current_worker = -1;
+
+static Result deque_init(TaskDeque* deque) {
+    deque->tasks = malloc(INITIAL_DEQUE_CAPACITY * sizeof(Task));
+    ASSERT_OR(deque->tasks, LIBC);
+    deque->capacity = INITIAL_DEQUE_CAPACITY;
+    deque->top = 0;
+    deque->bottom = 0;
+    pthread_mutex_init(&deque->lock, NULL);
+    return RESULT_OK;
+}
+
+static void deque_push(TaskDeque* deque, Task task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom - deque->top == deque->capacity) {
+        // Unroll the ring into a buffer twice as big
+        Task* tasks = malloc(2 * deque->capacity * sizeof(Task));
+        if (!tasks) {
+            perror("thread pool");
+            abort();
+        }
+        for (size_t i = deque->top; i < deque->bottom; i++)
+            tasks[i - deque->top] = deque->tasks[i % deque->capacity];
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->bottom -= deque->top;
+        deque->top = 0;
+        deque->capacity *= 2;
+    }
+    deque->tasks[deque->bottom++ % deque->capacity] = task;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+// Takes the newest task if `newest`, otherwise the oldest
+static bool deque_take(TaskDeque* deque, bool newest, Task* out) {
+    bool found = false;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top != deque->bottom) {
+        found = true;
+        if (newest)
+            *out = deque->tasks[--deque->bottom % deque->capacity];
+        else
+            *out = deque->tasks[deque->top++ % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Own deque first, then steal from the others
+static bool find_task(ThreadPool* pool, int index, Task* out) {
+    if (deque_take(&pool->deques[index], true, out))
+        return true;
+    for (int i = 1; i < pool->n_threads; i++) {
+        if (deque_take(&pool->deques[(index + i) % pool->n_threads], false, out))
+            return true;
+    }
+    return false;
+}
+
+static void* worker_main(void* arg) {
+    WorkerArgs* args = arg;
+    ThreadPool* pool = args->pool;
+    current_worker = args->index;
+    free(args);
+
+    for (;;) {
+        Task task;
+        if (find_task(pool, current_worker, &task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.func(task.arg);
+            if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->all_done);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+
+        // Submitters signal with the lock held after `queued` grows, so we
+        // can't miss a wake up
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) == 0 && !pool->stopping)
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        bool stopping = pool->stopping;
+        pthread_mutex_unlock(&pool->lock);
+        if (stopping) return NULL;
+    }
+}
+
+Result thread_pool_init(ThreadPool* this, int n_threads) {
+    memset(this, 0, sizeof(ThreadPool));
+    this->n_threads = n_threads;
+    this->threads = calloc(n_threads, sizeof(pthread_t));
+    this->deques = calloc(n_threads, sizeof(TaskDeque));
+    ASSERT_OR(this->threads && this->deques, LIBC);
+    pthread_mutex_init(&this->lock, NULL);
+    pthread_cond_init(&this->work_available, NULL);
+    pthread_cond_init(&this->all_done, NULL);
+
+    for (int i = 0; i < n_threads; i++)
+        ASSERT_OK(deque_init(&this->deques[i]));
+    for (int i = 0; i < n_threads; i++) {
+        WorkerArgs* args = malloc(sizeof(WorkerArgs));
+        ASSERT_OR(args, LIBC);
+        args->pool = this;
+        args->index = i;
+        int err = pthread_create(&this->threads[i], NULL, worker_main, args);
+        if (err) {
+            errno = err;
+            return ERROR(LIBC);
+        }
+    }
+    return RESULT_OK;
+}
+
+void thread_pool_submit(ThreadPool* pool, TaskFunc func, void* arg) {
+    int index = current_worker;
+    if (index < 0)
+        index = atomic_fetch_add(&pool->next_deque, 1) % pool->n_threads;
+
+    atomic_fetch_add(&pool->pending, 1);
+    // Counted before it's pushed, so that `queued` never drops below zero
+    atomic_fetch_add(&pool->queued, 1);
+    deque_push(&pool->deques[index], (Task){ .func = func, .arg = arg });
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_wait(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->pending) != 0)
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_destroy(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->n_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    free(pool->threads);
+    free(pool->deques);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->all_done);
+}
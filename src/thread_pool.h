@@ -0,0 +1,55 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "common.h"
+
+typedef void (*TaskFunc)(void* arg);
+
+typedef struct {
+    TaskFunc func;
+    void* arg;
+} Task;
+
+// Growable ring of tasks. Its worker pushes and pops at the bottom, so it
+// keeps working on the most recent, smallest, tasks while thieves take the
+// oldest ones from the top, which are usually the biggest.
+typedef struct {
+    pthread_mutex_t lock;
+    Task* tasks;
+    size_t capacity;
+    size_t top;
+    size_t bottom;
+} TaskDeque;
+
+// Fixed set of worker threads, each with its own deque of tasks. Workers that
+// run out of tasks steal from the others, so unbalanced work keeps every
+// thread busy. Tasks may submit more tasks.
+typedef struct {
+    int n_threads;
+    pthread_t* threads;
+    TaskDeque* deques;
+    // Tasks sitting in any deque
+    atomic_size_t queued;
+    // Tasks submitted that did not finish yet
+    atomic_size_t pending;
+    // Deque for tasks submitted from outside the pool
+    atomic_uint next_deque;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t all_done;
+    bool stopping;
+} ThreadPool;
+
+Result thread_pool_init(ThreadPool* this, int n_threads);
+
+// Queues `func(arg)` to run on some worker. When called from a worker, the
+// task goes on that worker's own deque.
+void thread_pool_submit(ThreadPool* pool, TaskFunc func, void* arg);
+
+// Blocks until every submitted task, including the ones they submitted, ran
+void thread_pool_wait(ThreadPool* pool);
+
+// Stops and joins the workers, the pool must be idle
+void thread_pool_destroy(ThreadPool* pool);
@@ -0,0 +1,133 @@
+#include <string.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "tt.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define GENERATION_MASK ((1 << TT_GENERATION_BITS) - 1)
+// Entries from this many searches ago weigh as much as one ply of depth less
+#define AGE_WEIGHT 8
+// Number of buckets looked at by `tt_hashfull`
+#define HASHFULL_SAMPLE (1000 / TT_BUCKET_SIZE)
+
+static inline uint64_t pack(Move move, int score, int depth, TTBound bound, unsigned generation) {
+    return (uint64_t)move
+         | (uint64_t)(uint16_t)score << 16
+         | (uint64_t)(uint8_t)depth << 32
+         | (uint64_t)bound << 40
+         | (uint64_t)(generation & GENERATION_MASK) << 42;
+}
+
+static inline Move data_move(uint64_t data) {
+    return data & 0xffff;
+}
+
+static inline int data_depth(uint64_t data) {
+    return (data >> 32) & 0xff;
+}
+
+static inline unsigned data_generation(uint64_t data) {
+    return (data >> 42) & GENERATION_MASK;
+}
+
+Result tt_init(TranspositionTable* this, size_t megabytes) {
+    size_t count = 1;
+    while (2 * count * sizeof(TTBucket) <= megabytes * 1024 * 1024)
+        count *= 2;
+    size_t size = count * sizeof(TTBucket);
+    size_t alignment = size >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : sizeof(TTBucket);
+    this->buckets = aligned_alloc(alignment, size);
+    ASSERT_OR(this->buckets, LIBC);
+#ifdef MADV_HUGEPAGE
+    // Only a hint, the table works the same without huge pages
+    if (alignment == HUGE_PAGE_SIZE)
+        madvise(this->buckets, size, MADV_HUGEPAGE);
+#endif
+    this->mask = count - 1;
+    this->generation = 0;
+    tt_clear(this);
+    return RESULT_OK;
+}
+
+void tt_clear(TranspositionTable* tt) {
+    memset(tt->buckets, 0, (tt->mask + 1) * sizeof(TTBucket));
+}
+
+void tt_new_search(TranspositionTable* tt) {
+    tt->generation = (tt->generation + 1) & GENERATION_MASK;
+}
+
+static inline TTBucket* tt_bucket(TranspositionTable* tt, uint64_t hash) {
+    return &tt->buckets[hash & tt->mask];
+}
+
+bool tt_probe(TranspositionTable* tt, uint64_t hash, TTHit* out) {
+    TTBucket* bucket = tt_bucket(tt, hash);
+    for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+        TTEntry* entry = &bucket->entries[i];
+        uint64_t key = atomic_load_explicit(&entry->key, memory_order_relaxed);
+        uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+        if ((key ^ data) != hash || data == 0) continue;
+        out->move = data_move(data);
+        out->score = (int16_t)(data >> 16);
+        out->depth = data_depth(data);
+        out->bound = (data >> 40) & 3;
+        return true;
+    }
+    return false;
+}
+
+void tt_store(TranspositionTable* tt, uint64_t hash, Move move, int score, int depth, TTBound bound) {
+    TTBucket* bucket = tt_bucket(tt, hash);
+    TTEntry* replace = NULL;
+    int replace_value = 0;
+    for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+        TTEntry* entry = &bucket->entries[i];
+        uint64_t key = atomic_load_explicit(&entry->key, memory_order_relaxed);
+        uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+        if ((key ^ data) == hash) {
+            // A shallow bound, say from a reduced null window search, is worth
+            // less than what this search already knows
+            if (bound != TT_BOUND_EXACT && depth < data_depth(data)
+                    && data_generation(data) == tt->generation)
+                return;
+            // Keep the best move of an earlier search of this position
+            if (move == NULL_MOVE)
+                move = data_move(data);
+            replace = entry;
+            break;
+        }
+        int age = (tt->generation - data_generation(data)) & GENERATION_MASK;
+        int value = data_depth(data) - AGE_WEIGHT * age;
+        if (!replace || value < replace_value) {
+            replace = entry;
+            replace_value = value;
+        }
+    }
+
+    uint64_t data = pack(move, score, depth, bound, tt->generation);
+    atomic_store_explicit(&replace->key, hash ^ data, memory_order_relaxed);
+    atomic_store_explicit(&replace->data, data, memory_order_relaxed);
+}
+
+int tt_hashfull(TranspositionTable* tt) {
+    size_t buckets = tt->mask + 1 < HASHFULL_SAMPLE ? tt->mask + 1 : HASHFULL_SAMPLE;
+    size_t used = 0;
+    for (size_t i = 0; i < buckets; i++) {
+        for (int j = 0; j < TT_BUCKET_SIZE; j++) {
+            uint64_t data = atomic_load_explicit(&tt->buckets[i].entries[j].data, memory_order_relaxed);
+            if (data != 0 && data_generation(data) == tt->generation)
+                used++;
+        }
+    }
+    return used * 1000 / (buckets * TT_BUCKET_SIZE);
+}
+
+size_t tt_size(TranspositionTable* tt) {
+    return (tt->mask + 1) * sizeof(TTBucket);
+}
+
+void tt_free(TranspositionTable* tt) {
+    free(tt->buckets);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdatomic.h>
+
+#include "common.h"
+
+// Entries sharing a cache line, any of them may hold a given position
+#define TT_BUCKET_SIZE 4
+// Generations wrap around, only the distance between two of them matters
+#define TT_GENERATION_BITS 6
+
+typedef enum {
+    TT_BOUND_NONE = 0,
+    // The score is at most the stored one, no move beat alpha
+    TT_BOUND_UPPER,
+    // The score is at least the stored one, a move beat beta
+    TT_BOUND_LOWER,
+    TT_BOUND_EXACT,
+} TTBound;
+
+// Like `PerftEntry`, the key is stored xored with the data so that a write
+// torn by another thread reads as a miss, see `perft_cache.h`. The data packs:
+//
+//     bits  0-15 best move
+//     bits 16-31 score
+//     bits 32-39 depth
+//     bits 40-41 bound
+//     bits 42-47 generation
+typedef struct {
+    atomic_uint_least64_t key;
+    atomic_uint_least64_t data;
+} TTEntry;
+
+typedef struct {
+    TTEntry entries[TT_BUCKET_SIZE];
+} __attribute__((aligned(64))) TTBucket;
+
+// What a search found about a position, keyed by its Zobrist hash. Shared by
+// all the search threads without locks.
+// source: https://www.chessprogramming.org/Transposition_Table
+typedef struct {
+    TTBucket* buckets;
+    size_t mask;
+    // Bumped by every new search, entries from older searches are replaced
+    // first
+    unsigned generation;
+} TranspositionTable;
+
+typedef struct {
+    Move move;
+    int score;
+    int depth;
+    TTBound bound;
+} TTHit;
+
+// Uses the largest power of two number of buckets that fits in `megabytes`.
+// Tables of 2 MB or more are aligned to and backed by huge pages where the
+// system supports it, so the whole table takes few TLB entries.
+Result tt_init(TranspositionTable* this, size_t megabytes);
+
+void tt_clear(TranspositionTable* tt);
+
+// Called before each search
+void tt_new_search(TranspositionTable* tt);
+
+bool tt_probe(TranspositionTable* tt, uint64_t hash, TTHit* out);
+
+// Replaces the entry of the same position if any, unless it is from this
+// search, deeper and the new result isn't exact. Otherwise replaces the least
+// useful entry of the bucket: the shallowest, older generations counting as
+// shallower.
+void tt_store(TranspositionTable* tt, uint64_t hash, Move move, int score, int depth, TTBound bound);
+
+// Permille of the entries used by the current search, from a sample of the
+// table as UCI's `hashfull`
+int tt_hashfull(TranspositionTable* tt);
+
+size_t tt_size(TranspositionTable* tt);
+
+void tt_free(TranspositionTable* tt);
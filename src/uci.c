@@ -1,12 +1,15 @@
 #include <string.h>
+#include <limits.h>
 
 #include "common.h"
 #include "uci.h"
 #include "fen.h"
+#include "moves.h"
 
 char const* const uci_command_kind_to_string[] = {
     // gui
     [UCI_INIT]           = "uci",
+    [UCI_NEWGAME]        = "ucinewgame",
     [UCI_DEBUG]          = "debug",
     [UCI_ISREADY]        = "isready",
     [UCI_SETOPTION]      = "setoption",
@@ -15,6 +18,7 @@ char const* const uci_command_kind_to_string[] = {
     [UCI_STOP]           = "stop",
     [UCI_PONDERHIT]      = "ponderhit",
     [UCI_QUIT]           = "quit",
+    [UCI_BENCH]          = "bench",
 
     // engine
     [UCI_OK]             = "uciok",
@@ -44,6 +48,113 @@ Result uci_parse_command_kind(const char* command, UciCommandKind* out) {
     return ERROR(INVALID_UCI);
 }
 
+// Plays the moves of a `position` command, in UCI notation separated by spaces
+static Result uci_parse_moves(char* linebuf, UciPosition* position) {
+    Game* game = &position->game;
+    char* s;
+    while ((s = strsep(&linebuf, delim))) {
+        if (*s == '\0') continue;
+        Move move;
+        ASSERT_OK(parse_move(s, &move));
+        ASSERT_OR(is_move_valid(&move, game), INVALID_UCI);
+        uint64_t hash = game->hash;
+        make_move(game, move);
+        // No position before a capture or pawn move can come back
+        if (game->halfmove_clock == 0) {
+            position->n_hashes = 0;
+            continue;
+        }
+        if (position->n_hashes == UCI_POSITION_HASHES) {
+            position->n_hashes--;
+            memmove(position->hashes, position->hashes + 1, position->n_hashes * sizeof(uint64_t));
+        }
+        position->hashes[position->n_hashes++] = hash;
+    }
+    return RESULT_OK;
+}
+
+static Result uci_parse_position(char* linebuf, UciPosition* position) {
+    Game* game = &position->game;
+    position->n_hashes = 0;
+    char* s = strsep(&linebuf, delim);
+    ASSERT_OR(s, INVALID_UCI);
+    // The FEN ends where the moves start
+    char* moves = linebuf ? strstr(linebuf, "moves") : NULL;
+    if (moves) *moves = '\0';
+
+    if (strcmp(s, "startpos") == 0) {
+        ASSERT_OK(parse_fen(game, FEN_STARTING));
+    } else if (strcmp(s, "fen") == 0) {
+        ASSERT_OR(linebuf, INVALID_UCI);
+        size_t len = strlen(linebuf);
+        while (len > 0 && strchr(delim, linebuf[len - 1])) len--;
+        linebuf[len] = '\0';
+        ASSERT_OK(parse_fen(game, linebuf));
+    } else {
+        return ERROR(INVALID_UCI);
+    }
+    if (moves) ASSERT_OK(uci_parse_moves(moves + strlen("moves"), position));
+    return RESULT_OK;
+}
+
+// Reads the number after a `go` parameter
+static Result uci_parse_go_value(char** linebuf, int* out) {
+    char* s = strsep(linebuf, delim);
+    ASSERT_OR(s, INVALID_UCI);
+    char* endp;
+    long value = strtol(s, &endp, 10);
+    ASSERT_OR(endp != s && *endp == '\0', INVALID_UCI);
+    *out = value;
+    return RESULT_OK;
+}
+
+static Result uci_parse_go(char* linebuf, UciGo* go) {
+    *go = (UciGo){0};
+    char* s;
+    while ((s = strsep(&linebuf, delim))) {
+        if (strcmp(s, "depth") == 0) {
+            ASSERT_OK(uci_parse_go_value(&linebuf, &go->depth));
+        } else if (strcmp(s, "movetime") == 0) {
+            ASSERT_OK(uci_parse_go_value(&linebuf, &go->movetime));
+        } else if (strcmp(s, "wtime") == 0) {
+            ASSERT_OK(uci_parse_go_value(&linebuf, &go->time[COLOR_WHITE]));
+        } else if (strcmp(s, "btime") == 0) {
+            ASSERT_OK(uci_parse_go_value(&linebuf, &go->time[COLOR_BLACK]));
+        } else if (strcmp(s, "winc") == 0) {
+            ASSERT_OK(uci_parse_go_value(&linebuf, &go->increment[COLOR_WHITE]));
+        } else if (strcmp(s, "binc") == 0) {
+            ASSERT_OK(uci_parse_go_value(&linebuf, &go->increment[COLOR_BLACK]));
+        } else if (strcmp(s, "movestogo") == 0) {
+            ASSERT_OK(uci_parse_go_value(&linebuf, &go->movestogo));
+        } else if (strcmp(s, "nodes") == 0) {
+            ASSERT_OK(uci_parse_go_value(&linebuf, &go->nodes));
+        } else if (strcmp(s, "infinite") == 0) {
+            go->infinite = true;
+        } else if (strcmp(s, "ponder") == 0) {
+            go->ponder = true;
+        }
+        // Parameters we don't support are ignored
+    }
+    return RESULT_OK;
+}
+
+// `setoption name <name> [value <value>]`, names may have spaces
+static Result uci_parse_setoption(char* linebuf, UciSetOption* option) {
+    char* s = strsep(&linebuf, delim);
+    ASSERT_OR(s && strcmp(s, "name") == 0 && linebuf, INVALID_UCI);
+    option->name = linebuf;
+    option->value = NULL;
+    char* value = strstr(linebuf, " value ");
+    if (value) {
+        *value = '\0';
+        option->value = value + strlen(" value ");
+        option->value[strcspn(option->value, "\r\n")] = '\0';
+    }
+    option->name[strcspn(option->name, "\r\n")] = '\0';
+    ASSERT_OR(*option->name != '\0', INVALID_UCI);
+    return RESULT_OK;
+}
+
 Result uci_parse_command(char* linebuf, UciCommand* out) {
     char* command = strsep(&linebuf, delim);
     ASSERT_OR(command, INVALID_UCI);
@@ -55,18 +166,32 @@ Result uci_parse_command(char* linebuf, UciCommand* out) {
         case UCI_READYOK:
         case UCI_COPYPROTECTION:
             break;
-        case UCI_POSITION: {
+        case UCI_POSITION:
+            return uci_parse_position(linebuf, &out->position);
+        case UCI_GO:
+            return uci_parse_go(linebuf, &out->go);
+        case UCI_SETOPTION:
+            return uci_parse_setoption(linebuf, &out->setoption);
+        case UCI_BENCH: {
+            out->bench = 0;
             char* s = strsep(&linebuf, delim);
-            if (strcmp(s, "startpos") == 0) {
-                return parse_fen(&out->position, FEN_STARTING);
-            } else if (strcmp(s, "fen") == 0) {
-                s = strsep(&linebuf, "\r\n");
-                if (!s) return ERROR(INVALID_UCI);
-                return parse_fen(&out->position, s);
-            }
+            if (!s || *s == '\0') return RESULT_OK;
+            char* endp;
+            long nodes = strtol(s, &endp, 10);
+            ASSERT_OR(endp != s && *endp == '\0' && nodes > 0 && nodes <= INT_MAX, INVALID_UCI);
+            out->bench = nodes;
+            return RESULT_OK;
         }
         case UCI_BESTMOVE: {
-            ASSERT_OK(parse_move(strsep(&linebuf, delim), &out->bestmove.move));
+            char* move = strsep(&linebuf, delim);
+            ASSERT_OR(move, INVALID_UCI);
+            out->bestmove.has_ponder = false;
+            // The null move, from an engine left without a legal move
+            if (strcmp(move, "0000") == 0) {
+                out->bestmove.move = NULL_MOVE;
+                return RESULT_OK;
+            }
+            ASSERT_OK(parse_move(move, &out->bestmove.move));
             char* s = strsep(&linebuf, delim);
             if (!s) return RESULT_OK;
             ASSERT_OR(strcmp(s, "ponder") == 0, INVALID_UCI);
@@ -7,6 +7,7 @@
 typedef enum {
     // gui
     UCI_INIT = 0,
+    UCI_NEWGAME,
     UCI_DEBUG,
     UCI_ISREADY,
     UCI_SETOPTION,
@@ -15,6 +16,8 @@ typedef enum {
     UCI_STOP,
     UCI_PONDERHIT,
     UCI_QUIT,
+    // Not part of UCI: searches a fixed set of positions and reports the speed
+    UCI_BENCH,
 
     // engine
     UCI_OK,
@@ -39,12 +42,51 @@ typedef struct {
     Move ponder;
 } UciBestMove;
 
+// Limits of a `go` command, 0 or false when not given
+typedef struct {
+    int depth;
+    // In milliseconds
+    int movetime;
+    int nodes;
+    bool infinite;
+    // Search the position after the expected reply until `ponderhit` or `stop`
+    bool ponder;
+    // Clocks and increments in milliseconds, by color
+    int time[2];
+    int increment[2];
+    // Moves until the next time control, 0 if the clock is all there is
+    int movestogo;
+} UciGo;
+
+// Both point into the parsed line, `value` is NULL for buttons
+typedef struct {
+    char* name;
+    char* value;
+} UciSetOption;
+
+// Positions of a `position` command kept to tell repetitions: older ones are
+// more than fifty moves back, where the game is drawn anyway
+#define UCI_POSITION_HASHES 100
+
+typedef struct {
+    // The FEN or start position with the moves after it already made
+    Game game;
+    // Hashes of the positions before `game` since the last capture or pawn
+    // move, oldest first
+    uint64_t hashes[UCI_POSITION_HASHES];
+    int n_hashes;
+} UciPosition;
+
 typedef struct {
     UciCommandKind kind;
     union {
         UciId id;
         UciBestMove bestmove;
-        Game position; // FEN string
+        UciPosition position;
+        UciGo go;
+        UciSetOption setoption;
+        // Nodes to search in each position, 0 for the default
+        int bench;
         char* other;
     };
 } UciCommand;
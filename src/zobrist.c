@@ -0,0 +1,30 @@
+#include "common.h"
+#include "zobrist.h"
+#include "bitboard.h"
+
+// The keys are generated at build time by `bin/gen_tables.c`
+
+int castling_rights(Game* game) {
+    int rights = 0;
+    for (PieceColor color = COLOR_WHITE; color <= COLOR_BLACK; color++) {
+        if (game->has_king_moved[color]) continue;
+        if (!game->has_rook_moved[color].kings) rights |= 1 << (2 * color);
+        if (!game->has_rook_moved[color].queens) rights |= 2 << (2 * color);
+    }
+    return rights;
+}
+
+uint64_t zobrist_hash(Game* game) {
+    uint64_t hash = 0;
+    Bitboard pieces = board_occupied(&game->board);
+    while (pieces) {
+        int index = bb_pop_lsb(&pieces);
+        hash ^= zobrist_square(game->board.squares[index / 8][index % 8], index);
+    }
+    hash ^= zobrist_castling[castling_rights(game)];
+    if (game->double_pushed.has)
+        hash ^= zobrist_en_passant[game->double_pushed.en_passant.file - 'a'];
+    if (game->turn == COLOR_BLACK)
+        hash ^= zobrist_black_to_move;
+    return hash;
+}
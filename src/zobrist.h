@@ -0,0 +1,27 @@
+#pragma once
+
+#include "common.h"
+
+// source: https://www.chessprogramming.org/Zobrist_Hashing
+extern TABLE_CONST uint64_t zobrist_pieces[2][NUM_PIECE_KINDS][64];
+// Indexed by `castling_rights`
+extern TABLE_CONST uint64_t zobrist_castling[16];
+// Indexed by the file of the en passant square
+extern TABLE_CONST uint64_t zobrist_en_passant[8];
+// Present when black is to move
+extern TABLE_CONST uint64_t zobrist_black_to_move;
+
+static inline uint64_t zobrist_piece(Piece piece, int index) {
+    return zobrist_pieces[piece.color][piece_kind_index(piece.kind)][index];
+}
+
+// Same as `zobrist_piece`, for a square that isn't empty
+static inline uint64_t zobrist_square(Square square, int index) {
+    return zobrist_pieces[square_color(square)][square_kind_index(square)][index];
+}
+
+// Castling rights still available to both sides as a 4 bit set
+int castling_rights(Game* game);
+
+// Computes the hash of `game` from scratch
+uint64_t zobrist_hash(Game* game);